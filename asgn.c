@@ -4,9 +4,25 @@
 #include <string.h>
 #include "htable.h"
 #include "mylib.h"
+#include "sdindex.h"
+#include "server.h"
+#include "pipeline.h"
+#include "perfctr.h"
+#include "sort.h"
+#include "writer.h"
+#include "cmsketch.h"
+#include <unistd.h>
 #include <time.h>
      
 #define DEFAULT_TABLE_SIZE 113   
+#define MAX_SUGGESTIONS 5
+#define SUGGEST_DISTANCE 2
+#define OUTPUT_BUFFER_SIZE 65536
+#define DEFAULT_EPSILON 0.0001
+#define DEFAULT_DELTA 0.01
+
+/* The order the words and frequencies are printed in. */
+typedef enum order_e { ORDER_SLOT, ORDER_ALPHA, ORDER_FREQ } order_t;
 
 /**
  * This static function prints out the help information when either -h
@@ -21,16 +37,62 @@ static void help(FILE *stream) {
 Perform various operations using a hash table.  By default, words are\n\
 read from stdin and added to the hash table, before being printed out\n\
 alongside their frequencies to stdout.\n\n");
+  fprintf(stream," -b IMAGE     Use the table saved in IMAGE (see -w) as a \
+read-only\n              base, adding the words from stdin to a small \
+overlay\n");
   fprintf(stream," -c FILENAME  Check spelling of words in FILENAME using \
 words\n              from stdin as dictionary.  Print unknown words to\n\
-              stdout, timing info & count to stderr (ignore -p)\n\
- -d           Use double hashing (linear probing is the default)\n"
-	  );
+              stdout, timing info & count to stderr (ignore -p)\n");
+  fprintf(stream," -D DELTA     Let the -E bound fail with probability \
+DELTA (if -k is\n              used, default %g)\n\
+ -d           Use double hashing (linear probing is the default)\n\
+ -E EPSILON   Let estimates be too high by at most EPSILON times the\n\
+              number of words (if -k is used, default %g)\n", DEFAULT_DELTA,
+	  DEFAULT_EPSILON);
   fprintf(stream," -e           Display entire contents of hash table on \
-stderr\n -p           Print stats info instead of frequencies & words\n\
+stderr\n\
+ -H           Print hardware performance counters for the fill and\n\
+              search phases to stderr\n\
+ -j WORKERS   Use WORKERS threads to serve requests (if -u is used)\n\
+ -k TOPK      Estimate frequencies in fixed memory with a Count-Min\n\
+              Sketch, and print only the TOPK most frequent words\n\
+ -M BYTES     Use at most BYTES (at least %d) for the sketch counters,\n\
+              loosening the -E and -D bounds if needed (if -k is used)\n\
+ -m           Print the memory used by the hash table (or the sketch, if\n\
+              -k is used) to stderr\n\
+ -o ORDER     Print words in ORDER: 'alpha' (alphabetical) or 'freq'\n\
+              (most frequent first, then alphabetical)\n\
+ -P           Read and search the document on separate threads \
+(if -c\n              is used), and print the time spent by each stage\n\
+ -p           Print stats info instead of frequencies & words\n\
+ -S           Suggest corrections for unknown words (if -c is used)\n\
  -s SNAPSHOTS Show SNAPSHOTS stats snapshots (if -p is used)\n\
- -t TABLESIZE Use the first prime >= TABLESIZE as htable size\n\n\
- -h           Display this message\n\n");  
+ -t TABLESIZE Use the first prime >= TABLESIZE as htable size\n\
+ -u SOCKET    Serve word checks on the Unix socket SOCKET instead of\n\
+              printing (stop with SIGINT or SIGTERM)\n\
+ -w IMAGE     Save the table filled from stdin to IMAGE (only the overlay\n\
+              if -b is used)\n\n\
+ -h           Display this message\n\n", CMSKETCH_MIN_BYTES);  
+}
+
+/**
+ * This static function copies a file name given with an option into one
+ * of main's 256 character buffers. A name that does not fit is an error
+ * rather than being dropped, so the option is never silently ignored.
+ *
+ * @param dest - the buffer to copy the name into.
+ * @param arg - the name given on the command line.
+ * @param prog - the name of the program, for the error message.
+ * @param option - the option the name was given with.
+ */
+
+static void copy_filename(char *dest, char *arg, char *prog, int option) {
+  if (strlen(arg) >= 256) {
+    fprintf(stderr, "%s: the file name given with -%c must be shorter "
+	    "than 256 characters\n", prog, option);
+    exit(EXIT_FAILURE);
+  }
+  strcpy(dest, arg);
 }
 
 /**
@@ -83,6 +145,131 @@ static void print_info(int freq, char *word) {
   printf("%-4d %s\n", freq, word);
 }
 
+/**
+ * This static function prints words and their frequencies to stdout in
+ * sorted order, in the same format as print_info. The words are radix
+ * sorted using one thread per processor, then written through a
+ * buffered writer.
+ *
+ * @param words - the words to print.
+ * @param freqs - the frequency of each word.
+ * @param n - the number of words.
+ * @param order - ORDER_ALPHA or ORDER_FREQ.
+ */
+
+static void print_entries(char **words, unsigned int *freqs, int n,
+			  order_t order) {
+  sort_entry *entries = emalloc((n > 0 ? n : 1) * sizeof entries[0]);
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  writer out;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    entries[i].word = words[i];
+    entries[i].freq = freqs[i];
+  }
+  /* The frequency sort is stable, so sorting alphabetically first
+   * leaves words with the same frequency in alphabetical order. */
+  sort_alpha(entries, n, threads);
+  if (order == ORDER_FREQ) {
+    sort_freq(entries, n, threads);
+  }
+
+  fflush(stdout);
+  out = writer_new(stdout, OUTPUT_BUFFER_SIZE);
+  for (i = 0; i < n; i++) {
+    writer_putu(out, entries[i].freq, 4);
+    writer_putc(out, ' ');
+    writer_puts(out, entries[i].word);
+    writer_putc(out, '\n');
+  }
+  writer_free(out);
+  free(entries);
+}
+
+/**
+ * This static function prints the words in the hashtable and their
+ * frequencies to stdout in sorted order. The occupied slots are
+ * collected and printed with print_entries.
+ *
+ * @param h - the hashtable to print.
+ * @param order - ORDER_ALPHA or ORDER_FREQ.
+ */
+
+static void print_sorted(htable h, order_t order) {
+  int n = htable_num_keys(h);
+  char **words = emalloc((n > 0 ? n : 1) * sizeof words[0]);
+  unsigned int *freqs = emalloc((n > 0 ? n : 1) * sizeof freqs[0]);
+
+  n = htable_collect(h, words, freqs);
+  print_entries(words, freqs, n, order);
+  free(words);
+  free(freqs);
+}
+
+/**
+ * This static function counts the words from stdin in fixed memory with
+ * a Count-Min Sketch, instead of a hashtable, and prints the top_k most
+ * frequent words with their estimated frequencies. The estimates are
+ * never too low, and are too high by at most epsilon times the number
+ * of words read, except with probability delta.
+ *
+ * @param top_k - the number of words to print.
+ * @param epsilon - the error allowed, as a fraction of the words read.
+ * @param delta - the probability that the error bound may fail.
+ * @param max_bytes - the most memory the sketch counters may use, or 0
+ *                    for no limit.
+ * @param m_option - if set, the memory used and the error bound are
+ *                   printed to stderr.
+ * @param order - ORDER_ALPHA, or ORDER_FREQ (which ORDER_SLOT is
+ *                treated as).
+ */
+
+static void count_stream(int top_k, double epsilon, double delta,
+			 long max_bytes, int m_option, order_t order) {
+  cmsketch s = cmsketch_new(epsilon, delta, max_bytes, top_k);
+  char **words = emalloc(top_k * sizeof words[0]);
+  unsigned int *freqs = emalloc(top_k * sizeof freqs[0]);
+  char word[256];
+  int n;
+
+  while (getword(word, sizeof word, stdin) != EOF) {
+    cmsketch_add(s, word);
+  }
+  if (m_option) {
+    cmsketch_print_info(s, stderr);
+  }
+  n = cmsketch_top(s, words, freqs);
+  print_entries(words, freqs, n, order == ORDER_ALPHA ? ORDER_ALPHA
+		: ORDER_FREQ);
+  free(words);
+  free(freqs);
+  cmsketch_free(s);
+}
+
+/**
+ * This static function adds every word of a table to a deletion index,
+ * so that words from a base table can be suggested as well as the words
+ * read from stdin.
+ *
+ * @param idx - the deletion index.
+ * @param h - the table whose words are added.
+ */
+
+static void add_to_index(sdindex idx, htable h) {
+  int n = htable_num_keys(h);
+  char **words = emalloc((n > 0 ? n : 1) * sizeof words[0]);
+  unsigned int *freqs = emalloc((n > 0 ? n : 1) * sizeof freqs[0]);
+  int i;
+
+  n = htable_collect(h, words, freqs);
+  for (i = 0; i < n; i++) {
+    sdindex_add(idx, words[i]);
+  }
+  free(words);
+  free(freqs);
+}
+
 /**
  * When finished checking text document for unknown words, this 
  * function prints timing information and unknown word count 
@@ -92,16 +279,81 @@ static void print_info(int freq, char *word) {
  *                      and compare with keys in the hashtable.
  * @param unknown_words - words that appear in the document, but
  *                        not the hash table.
+ * @param idx - the deletion index used for suggestions, or NULL if
+ *              suggestions were not requested.
+ * @param index_time - the time taken to build the deletion index.
  *
  *******************************************************************/
  
 static void print_textfile_info(double fill_time, double search_time,
-				int unknown_words) {
+				int unknown_words, sdindex idx,
+				double index_time) {
   fprintf(stderr,"Fill time     : %2.6f\n",fill_time);
+  if (idx != NULL) {
+    fprintf(stderr,"Index time    : %2.6f\n",index_time);
+    fprintf(stderr,"Index memory  : %lu bytes\n",
+	    (unsigned long) sdindex_memory(idx));
+  }
   fprintf(stderr,"Search time   : %2.6f\n",search_time);
   fprintf(stderr,"Unknown words = %d\n", unknown_words);
 }
 
+/**
+ * This static function prints an unknown word to stdout followed by
+ * the closest words to it in the deletion index, if there are any.
+ *
+ * @param idx - the deletion index to take suggestions from.
+ * @param word - the unknown word.
+ */
+
+static void print_suggestions(sdindex idx, char *word) {
+  char *suggestions[MAX_SUGGESTIONS];
+  int count, i;
+
+  count = sdindex_suggest(idx, word, suggestions, MAX_SUGGESTIONS);
+  printf("%s", word);
+  for (i = 0; i < count; i++) {
+    printf("%s%s", i == 0 ? " -> " : ", ", suggestions[i]);
+  }
+  printf("\n");
+}
+
+/**
+ * This static function reports a word from the document that is not in
+ * the hashtable. It is passed as a parameter to pipeline_check.
+ *
+ * @param word - the unknown word.
+ * @param idx - the deletion index to take suggestions from, or NULL to
+ *              print the word alone.
+ */
+
+static void report_unknown(char *word, void *idx) {
+  if (idx != NULL) {
+    print_suggestions(idx, word);
+  } else {
+    printf("%s\n",word);
+  }
+}
+
+/**
+ * When the document has been checked with -P, this function prints how
+ * long the reader and lookup stages spent working and waiting on each
+ * other to stderr. The stage that spends the least time waiting is the
+ * bottleneck.
+ *
+ * @param times - the stage timings recorded by pipeline_check.
+ */
+
+static void print_pipeline_info(pipeline_times *times) {
+  fprintf(stderr,"Batches       : %d\n", times->batches);
+  fprintf(stderr,"Read busy     : %2.6f\n", times->read_busy);
+  fprintf(stderr,"Read wait     : %2.6f\n", times->read_wait);
+  fprintf(stderr,"Lookup busy   : %2.6f\n", times->lookup_busy);
+  fprintf(stderr,"Lookup wait   : %2.6f\n", times->lookup_wait);
+  fprintf(stderr,"Bottleneck    : %s\n",
+	  times->read_busy > times->lookup_busy ? "read" : "lookup");
+}
+
 /**
  * This function deals with all the command line arguments that follow
  * the program when it is invoked. Just about all the parameters are 
@@ -114,6 +366,12 @@ static void print_textfile_info(double fill_time, double search_time,
  * @param *p_option - a reference to p_option defined in main. Used as a flag.
  * @param *e_option - a reference to e_option defined in main. Used as a flag.
  * @param *c_option - a reference to c_option defined in main. Used as a flag.
+ * @param *S_option - a reference to S_option defined in main. Used as a flag.
+ * @param *P_option - a reference to P_option defined in main. Used as a flag.
+ * @param *H_option - a reference to H_option defined in main. Used as a flag.
+ * @param *m_option - a reference to m_option defined in main. Used as a flag.
+ * @param *order - the order to print words in, which is set in this
+ *                 function.
  * @param *tableSize - a reference to tableSize defined in main. This 
  *                     variable defines the hashtable size.
  * @param *hashtype - this variable indicates if linear probing or double
@@ -124,24 +382,54 @@ static void print_textfile_info(double fill_time, double search_time,
  *                        of the document file, which is set in this function.
  * @param snapshots - the maximum number of statistical snapshots to print.
  *                    This value is set in this function.
+ * @param socket_path - the path of the Unix socket to serve requests on,
+ *                      which is set in this function. Left empty if the
+ *                      program should not run as a server.
+ * @param workers - the number of server worker threads. This value is
+ *                  set in this function.
+ * @param base_filename - the name of the table image to use as a base,
+ *                        which is set in this function. Left empty if
+ *                        there is no base.
+ * @param image_filename - the name of the file to save the table to,
+ *                         which is set in this function. Left empty if
+ *                         the table should not be saved.
+ * @param top_k - the number of words printed when frequencies are
+ *                estimated with a sketch, or 0 to use the hashtable.
+ *                This value is set in this function.
+ * @param epsilon - the sketch's error bound, set in this function.
+ * @param delta - the probability the sketch's error bound fails, set in
+ *                this function.
+ * @param max_bytes - the most memory the sketch may use, or 0 for no
+ *                    limit. This value is set in this function.
  */
 
-void readflags(int *p_option, int *e_option, int *c_option, int *tableSize,
+void readflags(int *p_option, int *e_option, int *c_option, int *S_option,
+               int *P_option, int *H_option, int *m_option,
+	       order_t *order, int *tableSize,
 	       hashing_t* hashtype, int argc, char *argv[],
-	       char *text_filename, int *snapshots) {
+	       char *text_filename, int *snapshots, char *socket_path,
+	       int *workers, char *base_filename, char *image_filename,
+	       int *top_k, double *epsilon, double *delta, long *max_bytes) {
   
-  const char *optstring = "c:deps:t:h";
+  const char *optstring = "b:c:D:dE:eHj:k:M:mo:PpSs:t:u:w:h";
   char option;
   int string_size_option;
   
   while ((option = getopt(argc, argv, optstring)) != EOF) {
     switch (option) {
+    case 'b':
+      /* Read the name of a saved table that the words from stdin
+	 are layered on top of. */
+      if (optarg!=NULL) {
+	copy_filename(base_filename, optarg, argv[0], option);
+      }
+      break;
     case 'c':
       /* If c is passed as a command line argument, read in the 
 	 name of the document text file and store in the char 
 	 string text_filename. */
       if (optarg!=NULL) {
-	strcpy(text_filename, optarg);
+	copy_filename(text_filename, optarg, argv[0], option);
       }
       *c_option=1; 
       break;
@@ -149,11 +437,76 @@ void readflags(int *p_option, int *e_option, int *c_option, int *tableSize,
       /* Set to double hashing. Linear probing is the default.  */
       *hashtype = DOUBLE_H;
       break;
+    case 'D':
+      /* The probability that the sketch's error bound fails. */
+      if (optarg!=NULL && atof(optarg) > 0 && atof(optarg) < 1) {
+	*delta=atof(optarg);
+      }
+      break;
+    case 'E':
+      /* The sketch's error bound, as a fraction of the words read. */
+      if (optarg!=NULL && atof(optarg) > 0 && atof(optarg) < 1) {
+	*epsilon=atof(optarg);
+      }
+      break;
     case 'e':
       /* If e is set to one, the entire contents of the hashtable
        * are printed. */
       *e_option =1;
       break;
+    case 'H':
+      /* If H is set to one, hardware performance counters are
+       * recorded for the fill and search phases. */
+      *H_option=1;
+      break;
+    case 'j':
+      /* The number of worker threads used by the server. */
+      if (optarg!=NULL && atoi(optarg) > 0) {
+	*workers=atoi(optarg);
+      }
+      break;
+    case 'k':
+      /* Estimate frequencies with a sketch and only print the
+	 given number of most frequent words. */
+      if (optarg!=NULL && atoi(optarg) > 0) {
+	*top_k=atoi(optarg);
+      }
+      break;
+    case 'M':
+      /* The most memory the sketch counters may use. A limit below
+	 the size of the smallest sketch is refused rather than
+	 quietly exceeded. */
+      if (optarg!=NULL && atol(optarg) > 0) {
+	*max_bytes=atol(optarg);
+	if (*max_bytes < CMSKETCH_MIN_BYTES) {
+	  fprintf(stderr, "%s: -M must be at least %d bytes\n", argv[0],
+		  CMSKETCH_MIN_BYTES);
+	  exit(EXIT_FAILURE);
+	}
+      }
+      break;
+    case 'm':
+      /* If m is set to one, the memory used by the hashtable is
+       * printed once it has been filled. */
+      *m_option=1;
+      break;
+    case 'o':
+      /* Print the words sorted alphabetically or by frequency
+       * instead of in hashtable order. */
+      if (strcmp(optarg, "alpha") == 0) {
+	*order = ORDER_ALPHA;
+      } else if (strcmp(optarg, "freq") == 0) {
+	*order = ORDER_FREQ;
+      } else {
+	help(stderr);
+	exit(EXIT_FAILURE);
+      }
+      break;
+    case 'P':
+      /* If P is set to one, the document is checked by a reader
+       * thread and a lookup thread connected by a ring buffer. */
+      *P_option=1;
+      break;
     case 'p':
       /* Check that the c option is not in the argument string. If
        * it is, skip this option. This flag when set will print 
@@ -162,6 +515,11 @@ void readflags(int *p_option, int *e_option, int *c_option, int *tableSize,
 	*p_option=1;
       }
       break;
+    case 'S':
+      /* If S is set to one, a deletion index is built alongside the
+       * hashtable and unknown words are printed with suggestions. */
+      *S_option=1;
+      break;
     case 's':
       /* This option if found in the command line arguments will
        * read in a number that will eventually be used to display 
@@ -183,6 +541,19 @@ void readflags(int *p_option, int *e_option, int *c_option, int *tableSize,
 	*tableSize=get_next_prime(string_size_option);
       }
       break;
+    case 'u':
+      /* Serve the dictionary on a Unix socket instead of printing
+	 anything. The path is checked when the socket is created. */
+      if (optarg!=NULL) {
+	copy_filename(socket_path, optarg, argv[0], option);
+      }
+      break;
+    case 'w':
+      /* Read the name of the file the filled table is saved to. */
+      if (optarg!=NULL) {
+	copy_filename(image_filename, optarg, argv[0], option);
+      }
+      break;
     case 'h':
       /* Call for help options. */
       help(stderr);
@@ -213,21 +584,34 @@ void readflags(int *p_option, int *e_option, int *c_option, int *tableSize,
  *                         of the document file to be read in by
  *                         this function.
  * @param fill_time - the time taken to fill in the hashtable.
+ * @param idx - the deletion index used to suggest corrections for
+ *              unknown words, or NULL to print the words alone.
+ * @param index_time - the time taken to build the deletion index.
+ * @param pipelined - if set, the document is read and searched on
+ *                    separate threads by pipeline_check.
+ * @param counters - the hardware counters to record the search with, or
+ *                   NULL if -H was not given.
  *
  */ 
 
-void process_txtfile(htable h, char *text_filename, double fill_time ) {
+void process_txtfile(htable h, char *text_filename, double fill_time,
+		     sdindex idx, double index_time, int pipelined,
+		     perfctr counters) {
 
   /* These two variables are used to determine the time it takes
    * for this program to check the document text file against the
    * hashtable. */
-  int start, end;
+  clock_t start, end;
+  /* The time spent by each stage when the search is pipelined. */
+  pipeline_times times;
   /* A double that stores the time it takes to search the document
    * text file. */
   double search_time;
   /* A count of words found in the document text file but not in the 
    * hashtable. */
   int unknown_words=0;
+  /* The number of words read from the document text file. */
+  long searches=0;
   /* This string is used to read in words in from the document text file
    * from stdin. */
   char word[256];
@@ -243,17 +627,40 @@ void process_txtfile(htable h, char *text_filename, double fill_time ) {
       exit(EXIT_FAILURE);
     }
   
-  start = clock();
-  while (getword(word, sizeof word, file_pointer) != EOF)
-    {
-      if (!htable_search(h,word)) {
-	printf("%s\n",word);
-	unknown_words++;
-      } 
-    }
-  end = clock();
-  search_time = ((double)(end-start))/CLOCKS_PER_SEC;
-  print_textfile_info(fill_time, search_time, unknown_words);
+  if (counters != NULL) {
+    perfctr_start(counters);
+  }
+  if (pipelined) {
+    /* clock() adds up the time of both threads, so the pipeline
+     * reports its own wall clock time instead. */
+    unknown_words = pipeline_check(h, file_pointer, report_unknown, idx,
+				   &times);
+    search_time = times.total;
+    searches = times.words;
+  } else {
+    start = clock();
+    while (getword(word, sizeof word, file_pointer) != EOF)
+      {
+	searches++;
+	if (!htable_search(h,word)) {
+	  report_unknown(word, idx);
+	  unknown_words++;
+	} 
+      }
+    end = clock();
+    search_time = ((double)(end-start))/CLOCKS_PER_SEC;
+  }
+  if (counters != NULL) {
+    perfctr_stop(counters);
+  }
+  print_textfile_info(fill_time, search_time, unknown_words, idx,
+		      index_time);
+  if (pipelined) {
+    print_pipeline_info(&times);
+  }
+  if (counters != NULL) {
+    perfctr_print(counters, "Search", searches, stderr);
+  }
 
   fclose(file_pointer);
 }
@@ -269,8 +676,10 @@ void process_txtfile(htable h, char *text_filename, double fill_time ) {
 
 int main(int argc, char *argv[]) {
 
-  /* The hashtable variable used in this program. */
+  /* The hashtable variable used in this program, and the read-only
+   * table it is layered on when -b is given. */
   htable h;
+  htable base = NULL;
   /* This string is used to read in words in from a dictionary file
    * from stdin. */
   char word[256];
@@ -279,12 +688,31 @@ int main(int argc, char *argv[]) {
   /* A string to store the name of the text file to check if it is
    * specified in the command line arguments. */
   char text_filename[256];
-  /* The following three integers are flags that are set depending
+  /* The following seven integers are flags that are set depending
    * the command line arguments used. The flags determine how this
    * program will process the dictionary and document files. */
   int p_option=0;
   int e_option=0;
   int c_option=0;
+  int S_option=0;
+  int P_option=0;
+  int H_option=0;
+  int m_option=0;
+  /* The order words are printed in when neither -c nor -p is used. */
+  order_t order = ORDER_SLOT;
+  /* Hardware counters for the fill and search phases when -H is given,
+   * and the number of words read while filling. */
+  perfctr fill_counters = NULL;
+  perfctr search_counters = NULL;
+  long inserts = 0;
+  /* The deletion index used to suggest corrections when -S is given,
+   * and the time spent building it. The base's words are indexed
+   * before the fill starts, and that part is kept apart so that only
+   * the index time inside the fill comes out of the fill time. */
+  sdindex idx = NULL;
+  clock_t index_start;
+  double index_time = 0.0;
+  double base_index_time = 0.0;
   /* These two variables are used to determine the time it takes
    * for this program to fill out a hashtable with words from a
    *  dictionary file. */
@@ -298,55 +726,153 @@ int main(int argc, char *argv[]) {
    * always be a prime number. The -t argument in the command line
    * will alter this value. */
   int tableSize = DEFAULT_TABLE_SIZE;
+  /* The socket path and number of worker threads used when -u is
+   * given, in which case the program serves requests until stopped. */
+  char socket_path[256] = "";
+  int workers = DEFAULT_WORKERS;
+  /* The table image used as a base when -b is given, and the file the
+   * table is saved to when -w is given. */
+  char base_filename[256] = "";
+  char image_filename[256] = "";
+  /* The number of words printed when -k is given, in which case the
+   * words are counted with a Count-Min Sketch rather than a hashtable,
+   * and the sketch's error bounds and memory limit. */
+  int top_k = 0;
+  double epsilon = DEFAULT_EPSILON;
+  double delta = DEFAULT_DELTA;
+  long max_bytes = 0;
 
   /* The following function reads in the command line arguments
      and sets the option flags based on the arguments use. */
    
-  readflags(&p_option, &e_option, &c_option, &tableSize, &hashtype,
-	    argc, argv,text_filename, &snapshots );
+  readflags(&p_option, &e_option, &c_option, &S_option, &P_option, &H_option,
+	    &m_option, &order, &tableSize, &hashtype,
+	    argc, argv,text_filename, &snapshots, socket_path, &workers,
+	    base_filename, image_filename, &top_k, &epsilon, &delta,
+	    &max_bytes );
+
+  /* With -k there is no hashtable: the words from stdin are counted in
+     the fixed memory of a sketch and the most frequent are printed. */
+
+  if (top_k > 0) {
+    count_stream(top_k, epsilon, delta, max_bytes, m_option, order);
+    return (EXIT_SUCCESS);
+  }
 
   /* The following instruction creates a new hashing table. The 
      parameters have default values but these may changed depending on
-     the program arguments. */
+     the program arguments. With -b the saved base table is mapped in
+     and the new table is an overlay on it, which uses the base's
+     hashing method. */
     
-  h=htable_new(tableSize, hashtype);
+  if (base_filename[0] != '\0') {
+    base = htable_load(base_filename);
+    if (base == NULL) {
+      fprintf(stderr, "%s: can't load table image '%s'\n", argv[0],
+	      base_filename);
+      exit(EXIT_FAILURE);
+    }
+    h=htable_new_overlay(base, tableSize);
+  } else {
+    h=htable_new(tableSize, hashtype);
+  }
+  /* Collision stats are only needed by -p and -e, so they are only
+     kept when one of those will print them. */
+  if ((p_option && !c_option) || e_option) {
+    htable_keep_stats(h);
+  }
+  if (S_option && c_option) {
+    idx = sdindex_new(SUGGEST_DISTANCE);
+    if (base != NULL) {
+      index_start = clock();
+      add_to_index(idx, base);
+      base_index_time = ((double) (clock() - index_start))/CLOCKS_PER_SEC;
+    }
+  }
 
   /* This section reads in words from the dictionary file that is 
      directed to this program from stdin. The time taken to read in
      the dictionary is determined using two clock functions and
-     the value is put into the variable fill_time. */
+     the value is put into the variable fill_time. When -S is used
+     each word is also added to the deletion index, and the time
+     spent doing that is kept separately in index_time. */
     
+  if (H_option) {
+    fill_counters = perfctr_new();
+    search_counters = perfctr_new();
+    perfctr_start(fill_counters);
+  }
   start = clock();
   while ((getword(word, sizeof word, stdin) != EOF) &&
 	 (htable_insert(h,word)!=-1)) {
+    inserts++;
+    if (idx != NULL) {
+      /* The index build is left out of both the fill time and the fill
+       * counters, so that they measure the same work. Pausing the
+       * counters is timed as part of the index. */
+      index_start = clock();
+      if (fill_counters != NULL) {
+	perfctr_stop(fill_counters);
+      }
+      sdindex_add(idx, word);
+      if (fill_counters != NULL) {
+	perfctr_start(fill_counters);
+      }
+      index_time += ((double) (clock() - index_start))/CLOCKS_PER_SEC;
+    }
   }
   end = clock();
-  fill_time = ((double) (end - start))/CLOCKS_PER_SEC;
+  fill_time = ((double) (end - start))/CLOCKS_PER_SEC - index_time;
+  index_time += base_index_time;
+  if (fill_counters != NULL) {
+    perfctr_stop(fill_counters);
+    perfctr_print(fill_counters, "Fill", inserts, stderr);
+  }
 
   /* If -e is specified in the command line arguments the 
    * htable_print_entire_table function will display entire contents 
-   * of hash table on stderr using the format string. */
+   * of hash table on stderr using the format string. If -m is
+   * specified the memory used by the hash table is printed too. */
     
   if (e_option) {
     htable_print_entire_table(h, stderr);
   }
+  if (m_option) {
+    htable_print_memory(h, stderr);
+  }
+  if (image_filename[0] != '\0' && htable_save(h, image_filename) != 0) {
+    fprintf(stderr, "%s: can't save table image '%s'\n", argv[0],
+	    image_filename);
+  }
 
   /* This next sections is the logic that deals with the option flags 
    * mentioned in an earlier comment. Depending of the combination of
    * command line arguments used, various stats about the hash table
    * and the state of the program will be printed. If the -c argument
    * is used a document file will be read in and processed. When this 
-   * option is given then the -p option is ignored. */
+   * option is given then the -p option is ignored. If -u is used the
+   * table is served over a Unix socket instead and nothing is printed. */
 
     
-  if (c_option==0) {
-    if (p_option==0) {
+  if (socket_path[0] != '\0') {
+    if (server_run(h, socket_path, workers) != 0) {
+      htable_free(h);
+      if (base != NULL) {
+	htable_free(base);
+      }
+      exit(EXIT_FAILURE);
+    }
+  } else if (c_option==0) {
+    if (p_option==0 && order != ORDER_SLOT) {
+      print_sorted(h, order);
+    } else if (p_option==0) {
       htable_print(h, print_info);
     } else {
       htable_print_stats(h, stdout, snapshots);
     }
   } else {
-    process_txtfile(h, text_filename,fill_time);
+    process_txtfile(h, text_filename,fill_time, idx, index_time, P_option,
+		    search_counters);
   }
 
   /* At this point of the programming all processing has occurred
@@ -354,6 +880,16 @@ int main(int argc, char *argv[]) {
    * program terminates. */
     
   htable_free(h);
+  if (base != NULL) {
+    htable_free(base);
+  }
+  if (idx != NULL) {
+    sdindex_free(idx);
+  }
+  if (H_option) {
+    perfctr_free(fill_counters);
+    perfctr_free(search_counters);
+  }
  
  
   return (EXIT_SUCCESS);
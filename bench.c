@@ -0,0 +1,379 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <getopt.h>
+#include <string.h>
+#include "htable.h"
+#include "htable_gen.h"
+#include "mylib.h"
+
+#define DEFAULT_KEYS 1000000
+#define DEFAULT_SEARCHES 5000000
+#define WORD_LENGTH 12
+
+HTABLE_GENERATE(bench_linear, char *, int, word_hash, word_eq, NULL,
+		HTABLE_PROBE_LINEAR)
+HTABLE_GENERATE(bench_double, char *, int, word_hash, word_eq, NULL,
+		HTABLE_PROBE_DOUBLE)
+
+/**
+ * This static function prints out the help information when either -h
+ * or some other incorrect command line arguement is used.
+ *
+ * @param stream - a stream to print the data to.
+ *
+ */
+
+static void help(FILE *stream) {
+  fprintf(stream,"Usage: ./bench [OPTION]...\n\n\
+Fill a hash table with random words and time random searches of it,\n\
+once with huge pages turned off and once with them turned on. Then time\n\
+the same searches with the original htable code, through htable_search,\n\
+with the hashing method chosen inside the probe loop, and through a table\n\
+generated for the method.\n\n");
+  fprintf(stream," -d           Use double hashing (linear probing is the \
+default)\n\
+ -n KEYS      Insert KEYS random words (default %d)\n\
+ -s SEARCHES  Do SEARCHES random searches (default %d)\n\n\
+ -h           Display this message\n\n", DEFAULT_KEYS, DEFAULT_SEARCHES);
+}
+
+/**
+ * This static function tests whether a number is a prime or not.
+ *
+ * @param candidate - the number that is checked.
+ *
+ * @return a boolean (as an int) showing if the number is a prime.
+ */
+
+static int is_prime(int candidate) {
+  int n;
+  for (n=2; n * n <= candidate;n++) {
+    if ((candidate %  n)==0) return 0;
+  }
+  return 1;
+}
+
+/**
+ * This static function fills a table with the words and then searches
+ * for randomly chosen words, printing the time per operation.
+ *
+ * @param label - the name printed with the results.
+ * @param words - the words to insert.
+ * @param num_words - the number of words.
+ * @param order - the index of the word to search for in each search.
+ * @param searches - the number of searches.
+ * @param table_size - the capacity of the table.
+ * @param method - the hashing method.
+ */
+
+static void run(char *label, char **words, int num_words, int *order,
+		int searches, int table_size, hashing_t method) {
+  htable h = htable_new(table_size, method);
+  double start, fill, search;
+  long found = 0;
+  int i;
+
+  start = now();
+  for (i = 0; i < num_words; i++) {
+    htable_insert(h, words[i]);
+  }
+  fill = now() - start;
+
+  start = now();
+  for (i = 0; i < searches; i++) {
+    found += htable_search(h, words[order[i]]);
+  }
+  search = now() - start;
+
+  printf("%-14s fill %8.1f ns/key   search %8.1f ns/op   (found %ld)\n",
+	 label, fill * 1e9 / num_words, search * 1e9 / searches, found);
+  htable_free(h);
+}
+
+/**
+ * A table laid out the way htable was before it was tuned: each key in
+ * its own malloc'd string and an int frequency for every slot.
+ */
+
+struct baseline {
+  int capacity;
+  char **items;
+  int *frequencies;
+  hashing_t method;
+};
+
+/**
+ * This static function inserts a word into a baseline table, probing the
+ * way the original htable_insert did.
+ *
+ * @param b - the table.
+ * @param word - the word to insert.
+ */
+
+static void baseline_insert(struct baseline *b, char *word) {
+  int key = word_hash(word) % b->capacity;
+  int collisions = 0;
+
+  while (b->items[key] != NULL && strcmp(b->items[key], word) != 0
+	 && collisions < b->capacity) {
+    if (b->method == LINEAR_P) {
+      key = (key + 1) % b->capacity;
+    } else {
+      key = (key + 1 + word_hash(word) % (b->capacity - 1)) % b->capacity;
+    }
+    collisions++;
+  }
+  if (collisions < b->capacity) {
+    if (b->items[key] == NULL) {
+      b->items[key] = emalloc(strlen(word) + 1);
+      strcpy(b->items[key], word);
+    }
+    b->frequencies[key]++;
+  }
+}
+
+/**
+ * This static function is the original htable_search with its linear
+ * probing and double hashing loops: the method is checked once per call,
+ * and for double hashing the word is rehashed on every probe.
+ *
+ * @param b - the table.
+ * @param word - the word to search for.
+ *
+ * @return the word's frequency, or 0 if it is not in the table.
+ */
+
+static int baseline_search(struct baseline *b, char *word) {
+  int key = word_hash(word) % b->capacity;
+  int collisions = 0;
+
+  if (b->method == LINEAR_P) {
+    while (b->items[key] != NULL && strcmp(word, b->items[key]) != 0
+	   && collisions < b->capacity) {
+      key = (key + 1) % b->capacity;
+      collisions++;
+    }
+  } else {
+    while (b->items[key] != NULL && strcmp(b->items[key], word) != 0
+	   && collisions < b->capacity) {
+      collisions++;
+      key = (key + 1 + word_hash(word) % (b->capacity - 1)) % b->capacity;
+    }
+  }
+  return collisions >= b->capacity ? 0 : b->frequencies[key];
+}
+
+/**
+ * This static function searches a generated table's arrays with the
+ * hashing method checked, and for double hashing the step recomputed, on
+ * every probe. Against the generated table's own search this isolates
+ * the cost of the dispatch, as both read the same arrays.
+ *
+ * @param keys - the keys of the table to search.
+ * @param vals - the values of the table to search.
+ * @param capacity - the capacity of the table.
+ * @param method - the hashing method.
+ * @param word - the word to search for.
+ *
+ * @return the word's value, or 0 if it is not in the table.
+ */
+
+static int runtime_search(char **keys, int *vals, int capacity,
+			  hashing_t method, char *word) {
+  int pos = word_hash(word) % capacity;
+  int collisions = 0;
+
+  while (keys[pos] != NULL && strcmp(keys[pos], word) != 0
+	 && collisions < capacity) {
+    if (method == LINEAR_P) {
+      pos = (pos + 1) % capacity;
+    } else {
+      pos = (pos + 1 + word_hash(word) % (capacity - 1)) % capacity;
+    }
+    collisions++;
+  }
+  return collisions < capacity ? vals[pos] : 0;
+}
+
+/**
+ * This static function times the same searches four ways. The original
+ * htable code on its own layout is compared with htable_search, which
+ * binds a search function for the method and frequency width when the
+ * table is built. Then a per-probe dispatch loop and a table generated
+ * for the method are compared on the same arrays.
+ *
+ * @param words - the words to insert.
+ * @param num_words - the number of words.
+ * @param order - the index of the word to search for in each search.
+ * @param searches - the number of searches.
+ * @param table_size - the capacity of the table.
+ * @param method - the hashing method.
+ */
+
+static void run_dispatch(char **words, int num_words, int *order,
+			 int searches, int table_size, hashing_t method) {
+  htable h = htable_new(table_size, method);
+  struct baseline b;
+  struct bench_linear lt;
+  struct bench_double dt;
+  char **keys;
+  int *vals;
+  char *copies = emalloc(num_words * (WORD_LENGTH + 1));
+  double start, original, runtime, dispatched, generated;
+  long found[4] = {0, 0, 0, 0};
+  int i;
+
+  b.capacity = table_size;
+  b.method = method;
+  b.items = emalloc(table_size * sizeof b.items[0]);
+  b.frequencies = emalloc(table_size * sizeof b.frequencies[0]);
+  for (i = 0; i < table_size; i++) {
+    b.items[i] = NULL;
+    b.frequencies[i] = 0;
+  }
+  bench_linear_init(&lt, table_size);
+  bench_double_init(&dt, table_size);
+  /* The generated tables get their own copies of the keys, as htable
+   * does, so that no search compares a word with itself. */
+  for (i = 0; i < num_words; i++) {
+    char *copy = strcpy(copies + i * (WORD_LENGTH + 1), words[i]);
+    htable_insert(h, words[i]);
+    baseline_insert(&b, words[i]);
+    if (method == LINEAR_P) {
+      *bench_linear_put(&lt, copy) += 1;
+    } else {
+      *bench_double_put(&dt, copy) += 1;
+    }
+  }
+  keys = method == LINEAR_P ? lt.keys : dt.keys;
+  vals = method == LINEAR_P ? lt.vals : dt.vals;
+
+  start = now();
+  for (i = 0; i < searches; i++) {
+    found[0] += baseline_search(&b, words[order[i]]);
+  }
+  original = now() - start;
+
+  start = now();
+  for (i = 0; i < searches; i++) {
+    found[1] += htable_search(h, words[order[i]]);
+  }
+  dispatched = now() - start;
+
+  start = now();
+  for (i = 0; i < searches; i++) {
+    found[2] += runtime_search(keys, vals, table_size, method,
+			       words[order[i]]);
+  }
+  runtime = now() - start;
+
+  start = now();
+  if (method == LINEAR_P) {
+    for (i = 0; i < searches; i++) {
+      found[3] += *bench_linear_get(&lt, words[order[i]]);
+    }
+  } else {
+    for (i = 0; i < searches; i++) {
+      found[3] += *bench_double_get(&dt, words[order[i]]);
+    }
+  }
+  generated = now() - start;
+
+  printf("original htable     %8.1f ns/op   (found %ld)\n",
+	 original * 1e9 / searches, found[0]);
+  printf("htable_search       %8.1f ns/op   (found %ld)\n",
+	 dispatched * 1e9 / searches, found[1]);
+  printf("per-probe dispatch  %8.1f ns/op   (found %ld)\n",
+	 runtime * 1e9 / searches, found[2]);
+  printf("generated table     %8.1f ns/op   (found %ld)\n",
+	 generated * 1e9 / searches, found[3]);
+
+  for (i = 0; i < table_size; i++) {
+    free(b.items[i]);
+  }
+  free(b.items);
+  free(b.frequencies);
+  bench_linear_destroy(&lt);
+  bench_double_destroy(&dt);
+  free(copies);
+  htable_free(h);
+}
+
+/**
+ *
+ *This is the function that is first invoked when the program runs
+ *
+ * @param argc - this is the count of command line arguments
+ * @param argv - this is a string array of command line arguments
+ *
+ *********************************/
+
+int main(int argc, char *argv[]) {
+  int num_words = DEFAULT_KEYS;
+  int searches = DEFAULT_SEARCHES;
+  hashing_t method = LINEAR_P;
+  char **words;
+  int *order;
+  int table_size;
+  int option;
+  int i, j;
+
+  while ((option = getopt(argc, argv, "dn:s:h")) != -1) {
+    switch (option) {
+    case 'd':
+      method = DOUBLE_H;
+      break;
+    case 'n':
+      num_words = atoi(optarg) > 0 ? atoi(optarg) : DEFAULT_KEYS;
+      break;
+    case 's':
+      searches = atoi(optarg) > 0 ? atoi(optarg) : DEFAULT_SEARCHES;
+      break;
+    case 'h':
+      help(stderr);
+      exit(EXIT_SUCCESS);
+    default:
+      help(stderr);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  /* Random lowercase words are almost never repeated, so every insert
+   * adds a key. The table is kept about half full. */
+  srand(242);
+  words = emalloc(num_words * sizeof words[0]);
+  for (i = 0; i < num_words; i++) {
+    words[i] = emalloc(WORD_LENGTH + 1);
+    for (j = 0; j < WORD_LENGTH; j++) {
+      words[i][j] = 'a' + rand() % 26;
+    }
+    words[i][WORD_LENGTH] = '\0';
+  }
+  order = emalloc(searches * sizeof order[0]);
+  for (i = 0; i < searches; i++) {
+    order[i] = rand() % num_words;
+  }
+  for (table_size = 2 * num_words + 1; !is_prime(table_size); table_size++) {
+  }
+
+  printf("%d keys, %d searches, table size %d, %s, THP mode %s\n\n",
+	 num_words, searches, table_size,
+	 method == LINEAR_P ? "linear probing" : "double hashing",
+	 halloc_thp_mode());
+
+  halloc_use_huge_pages(0);
+  run("normal pages", words, num_words, order, searches, table_size, method);
+  halloc_use_huge_pages(1);
+  run("huge pages", words, num_words, order, searches, table_size, method);
+  printf("\n");
+  halloc_report(stdout);
+  printf("\n");
+  run_dispatch(words, num_words, order, searches, table_size, method);
+
+  for (i = 0; i < num_words; i++) {
+    free(words[i]);
+  }
+  free(words);
+  free(order);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,226 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <getopt.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "mylib.h"
+#include "server.h"
+
+#define DEFAULT_BATCH_SIZE 64
+
+/**
+ * This static function prints out the help information when either -h
+ * or some other incorrect command line arguement is used.
+ *
+ * @param stream - a stream to print the data to.
+ *
+ */
+
+static void help(FILE *stream) {
+  fprintf(stream,"Usage: ./client [OPTION]... <STDIN>\n\n\
+Check the spelling of words read from stdin against a dictionary served\n\
+by './asgn -u SOCKET'.  Unknown words are printed to stdout and the\n\
+count to stderr.\n\n");
+  fprintf(stream," -u SOCKET    Connect to SOCKET (default %s)\n\
+ -n BATCH     Send BATCH words per request (default %d)\n\
+ -b ROUNDS    Benchmark: send the words ROUNDS times and print request\n\
+              latency to stderr instead of the unknown words\n\n\
+ -h           Display this message\n\n",
+	  DEFAULT_SOCKET_PATH, DEFAULT_BATCH_SIZE);
+}
+
+/**
+ * This static function connects to the server's Unix domain socket.
+ *
+ * @param socket_path - the path of the socket.
+ *
+ * @return the connected socket, or exits if the connection fails.
+ */
+
+static int connect_server(char *socket_path) {
+  struct sockaddr_un addr;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  memset(&addr, 0, sizeof addr);
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socket_path, sizeof addr.sun_path - 1);
+  if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof addr) != 0) {
+    perror(socket_path);
+    exit(EXIT_FAILURE);
+  }
+  return fd;
+}
+
+/**
+ * This static function sends one request holding words[first] up to
+ * words[first + count - 1] and reads the response line.
+ *
+ * @param fd - the connected socket.
+ * @param response - the stream that responses are read from.
+ * @param words - the words read from stdin.
+ * @param first - the index of the first word in the request.
+ * @param count - the number of words in the request.
+ * @param freqs - the frequency of each word is stored here.
+ */
+
+static void send_batch(int fd, FILE *response, char **words, int first,
+		       int count, int *freqs) {
+  static char *request = NULL;
+  static size_t request_cap = 0;
+  size_t len = 0;
+  size_t need;
+  ssize_t n;
+  int i;
+
+  for (i = 0; i < count; i++) {
+    need = len + strlen(words[first + i]) + 2;
+    if (need > request_cap) {
+      request_cap = need * 2;
+      request = erealloc(request, request_cap);
+    }
+    len += sprintf(request + len, i == 0 ? "%s" : " %s", words[first + i]);
+  }
+  request[len++] = '\n';
+
+  for (i = 0; i < (int) len; i += n) {
+    n = write(fd, request + i, len - i);
+    if (n <= 0) {
+      fprintf(stderr, "Lost connection to server.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (i = 0; i < count; i++) {
+    if (fscanf(response, "%d", &freqs[i]) != 1) {
+      fprintf(stderr, "Bad response from server.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+/**
+ * This static function is used with qsort to order latencies.
+ *
+ * @param a - a pointer to the first latency.
+ * @param b - a pointer to the second latency.
+ *
+ * @return a negative, zero or positive number as a is less than, equal
+ *         to or greater than b.
+ */
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+/**
+ *
+ *This is the function that is first invoked when the program runs
+ *
+ * @param argc - this is the count of command line arguments
+ * @param argv - this is a string array of command line arguments
+ *
+ *********************************/
+
+int main(int argc, char *argv[]) {
+  char *socket_path = DEFAULT_SOCKET_PATH;
+  int batch_size = DEFAULT_BATCH_SIZE;
+  int rounds = 0;
+  char word[256];
+  char **words = NULL;
+  int num_words = 0;
+  int words_cap = 0;
+  int *freqs;
+  double *latency = NULL;
+  int num_requests = 0;
+  int unknown_words = 0;
+  double start, total;
+  FILE *response;
+  int option;
+  int fd, i, r, count;
+
+  while ((option = getopt(argc, argv, "u:n:b:h")) != -1) {
+    switch (option) {
+    case 'u':
+      socket_path = optarg;
+      break;
+    case 'n':
+      batch_size = atoi(optarg) > 0 ? atoi(optarg) : DEFAULT_BATCH_SIZE;
+      break;
+    case 'b':
+      rounds = atoi(optarg);
+      break;
+    case 'h':
+      help(stderr);
+      exit(EXIT_SUCCESS);
+    default:
+      help(stderr);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  /* Read and normalise every word first so that the benchmark only
+   * measures the round trips to the server. */
+  while (getword(word, sizeof word, stdin) != EOF) {
+    if (num_words == words_cap) {
+      words_cap = words_cap == 0 ? 1024 : words_cap * 2;
+      words = erealloc(words, words_cap * sizeof words[0]);
+    }
+    words[num_words] = emalloc(strlen(word) + 1);
+    strcpy(words[num_words++], word);
+  }
+
+  fd = connect_server(socket_path);
+  response = fdopen(dup(fd), "r");
+  freqs = emalloc(batch_size * sizeof freqs[0]);
+
+  if (rounds <= 0) {
+    for (i = 0; i < num_words; i += batch_size) {
+      count = num_words - i < batch_size ? num_words - i : batch_size;
+      send_batch(fd, response, words, i, count, freqs);
+      for (r = 0; r < count; r++) {
+	if (freqs[r] == 0) {
+	  printf("%s\n", words[i + r]);
+	  unknown_words++;
+	}
+      }
+    }
+    fprintf(stderr, "Unknown words = %d\n", unknown_words);
+  } else if (num_words > 0) {
+    latency = emalloc(rounds * ((num_words + batch_size - 1) / batch_size)
+		      * sizeof latency[0]);
+    total = now();
+    for (r = 0; r < rounds; r++) {
+      for (i = 0; i < num_words; i += batch_size) {
+	count = num_words - i < batch_size ? num_words - i : batch_size;
+	start = now();
+	send_batch(fd, response, words, i, count, freqs);
+	latency[num_requests++] = now() - start;
+      }
+    }
+    total = now() - total;
+    qsort(latency, num_requests, sizeof latency[0], compare_double);
+    fprintf(stderr, "Requests      : %d (%d words each)\n", num_requests,
+	    batch_size);
+    fprintf(stderr, "Total time    : %2.6f\n", total);
+    fprintf(stderr, "Words/second  : %.0f\n", rounds * num_words / total);
+    fprintf(stderr, "Latency min   : %2.6f\n", latency[0]);
+    fprintf(stderr, "Latency p50   : %2.6f\n", latency[num_requests / 2]);
+    fprintf(stderr, "Latency p99   : %2.6f\n",
+	    latency[(int) (num_requests * 0.99)]);
+    fprintf(stderr, "Latency max   : %2.6f\n", latency[num_requests - 1]);
+    free(latency);
+  }
+
+  fclose(response);
+  close(fd);
+  for (i = 0; i < num_words; i++) {
+    free(words[i]);
+  }
+  free(words);
+  free(freqs);
+  return EXIT_SUCCESS;
+}
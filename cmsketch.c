@@ -0,0 +1,369 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cmsketch.h"
+#include "htable_gen.h"
+#include "mylib.h"
+
+/* Rows are padded to a whole number of cache lines, and start on one. */
+#define CACHE_LINE 64
+#define ROW_MULTIPLE (CACHE_LINE / (int) sizeof(uint32_t))
+#define MAX_DEPTH 16
+
+/**
+ * A word being tracked as one of the top K, and its estimated count.
+ */
+struct hitter {
+    char *word;
+    unsigned int count;
+};
+
+HTABLE_GENERATE(hitters, char *, int, word_hash, word_eq, NULL,
+                HTABLE_PROBE_LINEAR)
+HTABLE_GENERATE_REMOVE(hitters, char *, word_hash, NULL)
+
+/**
+ * cmsketch struct. The counters are depth rows of width uint32_t each,
+ * stored one after the other in a single cache line aligned block, so
+ * that every row starts on a cache line. The current top K words are
+ * kept in a min-heap ordered by count, with a table from each word to
+ * its position in the heap.
+ */
+struct cmsketchrec {
+    int width;
+    int depth;
+    uint32_t *counters;
+    void *block;
+    size_t blockSize;
+    unsigned long total;
+    struct hitter *heap;
+    int numHitters;
+    int topK;
+    size_t hitterBytes;
+    struct hitters table;
+};
+
+/**
+ * This static method hashes a word to the two 32 bit halves of a 64 bit
+ * FNV-1a hash. The hash is finished with the MurmurHash3 mixer, because
+ * the rows are indexed by the high bits of each half, which FNV-1a
+ * barely changes for short words. Row i uses h1 + i * h2 (Kirsch and
+ * Mitzenmacher), which is as good as depth independent hashes for a
+ * Count-Min Sketch. h2 is made odd so that no two rows use the same hash.
+ *
+ * @param word the word to hash.
+ * @param h1 the first hash is stored here.
+ * @param h2 the second hash is stored here.
+ */
+static void sketchHash(char *word, uint32_t *h1, uint32_t *h2){
+    uint64_t h = 14695981039346656037ULL;
+    while(*word != '\0'){
+        h ^= (unsigned char) *word++;
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    *h1 = (uint32_t) h;
+    *h2 = (uint32_t) (h >> 32) | 1;
+}
+
+/**
+ * This static method works out the counter a word uses in each row.
+ * The hash is mapped onto the row with a multiply and shift rather than
+ * a division.
+ *
+ * @param s the sketch.
+ * @param word the word.
+ * @param pos the index of the counter in each row is stored here.
+ */
+static void sketchPositions(cmsketch s, char *word, uint32_t *pos){
+    uint32_t h1, h2;
+    int i;
+
+    sketchHash(word, &h1, &h2);
+    for(i = 0; i < s->depth; i++){
+        pos[i] = i * s->width
+            + (uint32_t) (((uint64_t) (h1 + i * h2) * s->width) >> 32);
+    }
+}
+
+/**
+ * This static method swaps two entries of the heap, keeping the table
+ * of heap positions up to date.
+ *
+ * @param s the sketch.
+ * @param i the first position.
+ * @param j the second position.
+ */
+static void heapSwap(cmsketch s, int i, int j){
+    struct hitter t = s->heap[i];
+    s->heap[i] = s->heap[j];
+    s->heap[j] = t;
+    *hitters_get(&s->table, s->heap[i].word) = i;
+    *hitters_get(&s->table, s->heap[j].word) = j;
+}
+
+/**
+ * This static method moves an entry towards the root of the heap until
+ * its parent's count is no bigger.
+ *
+ * @param s the sketch.
+ * @param i the position of the entry.
+ */
+static void heapUp(cmsketch s, int i){
+    while(i > 0 && s->heap[(i - 1) / 2].count > s->heap[i].count){
+        heapSwap(s, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+/**
+ * This static method moves an entry away from the root of the heap
+ * until neither child has a smaller count.
+ *
+ * @param s the sketch.
+ * @param i the position of the entry.
+ */
+static void heapDown(cmsketch s, int i){
+    int child;
+
+    while((child = 2 * i + 1) < s->numHitters){
+        if(child + 1 < s->numHitters &&
+           s->heap[child + 1].count < s->heap[child].count){
+            child++;
+        }
+        if(s->heap[i].count <= s->heap[child].count){
+            break;
+        }
+        heapSwap(s, i, child);
+        i = child;
+    }
+}
+
+/**
+ * This static method copies a word into the heap at a position and adds
+ * it to the table.
+ *
+ * @param s the sketch.
+ * @param i the position in the heap.
+ * @param word the word.
+ * @param count the word's estimated count.
+ */
+static void heapSet(cmsketch s, int i, char *word, unsigned int count){
+    size_t length = strlen(word) + 1;
+
+    s->heap[i].word = emalloc(length);
+    memcpy(s->heap[i].word, word, length);
+    s->heap[i].count = count;
+    *hitters_put(&s->table, s->heap[i].word) = i;
+    s->hitterBytes += length;
+}
+
+/**
+ * This method creates a Count-Min Sketch sized so that, with probability
+ * at least 1 - delta, no estimate exceeds the true count by more than
+ * epsilon times the number of words added. If the counters would need
+ * more than max_bytes, the rows are made narrower to fit and the bound
+ * gets looser; if even rows one cache line wide would not fit, there are
+ * fewer of them, which loosens the probability too. The top_k words with
+ * the highest estimates are tracked as words are added.
+ *
+ * @param epsilon the error allowed, as a fraction of the words added.
+ * @param delta the probability that the error bound may fail.
+ * @param max_bytes the most memory the counters may use, or 0 for no
+ *                  limit. It must be at least CMSKETCH_MIN_BYTES.
+ * @param top_k the number of heavy hitters to track.
+ *
+ * @return result the sketch that has been created.
+ */
+cmsketch cmsketch_new(double epsilon, double delta, size_t max_bytes,
+                      int top_k){
+    cmsketch result = emalloc(sizeof *result);
+    double width = ceil(exp(1.0) / epsilon);
+    int depth = (int) ceil(log(1.0 / delta));
+    size_t counterBytes;
+    uintptr_t start;
+
+    if(depth < 1){
+        depth = 1;
+    }
+    if(depth > MAX_DEPTH){
+        depth = MAX_DEPTH;
+    }
+    if(max_bytes > 0 && depth * (size_t) CACHE_LINE > max_bytes){
+        depth = max_bytes < CACHE_LINE ? 1 : max_bytes / CACHE_LINE;
+    }
+    if(max_bytes > 0 && width * depth * sizeof(uint32_t) > max_bytes){
+        width = max_bytes / (depth * sizeof(uint32_t));
+    }
+    if(width > INT32_MAX / MAX_DEPTH){
+        width = INT32_MAX / MAX_DEPTH;
+    }
+    result->width = ((int) width + ROW_MULTIPLE - 1) / ROW_MULTIPLE
+        * ROW_MULTIPLE;
+    if(max_bytes > 0 && result->width > ROW_MULTIPLE &&
+       (size_t) result->width * depth * sizeof(uint32_t) > max_bytes){
+        result->width -= ROW_MULTIPLE;
+    }
+    if(result->width < ROW_MULTIPLE){
+        result->width = ROW_MULTIPLE;
+    }
+    result->depth = depth;
+
+    counterBytes = (size_t) result->width * depth * sizeof(uint32_t);
+    result->blockSize = counterBytes + CACHE_LINE;
+    result->block = halloc(result->blockSize);
+    start = ((uintptr_t) result->block + CACHE_LINE - 1)
+        & ~(uintptr_t) (CACHE_LINE - 1);
+    result->counters = (uint32_t *) start;
+    memset(result->counters, 0, counterBytes);
+    result->total = 0;
+
+    result->topK = top_k > 0 ? top_k : 1;
+    result->heap = emalloc(result->topK * sizeof result->heap[0]);
+    result->numHitters = 0;
+    hitters_init(&result->table, 2 * result->topK + 1);
+    result->hitterBytes = result->topK * sizeof result->heap[0]
+        + result->table.capacity
+        * (sizeof result->table.keys[0] + sizeof result->table.vals[0]);
+    return result;
+}
+
+/**
+ * This method counts one occurrence of a word. With conservative update
+ * only the counters that hold the word's current minimum are raised, to
+ * one more than that minimum, which keeps the other counters from growing
+ * on behalf of other words. If the word's new estimate puts it in the top
+ * K it replaces the word with the lowest estimate there.
+ *
+ * @param s the sketch.
+ * @param word the word to count.
+ */
+void cmsketch_add(cmsketch s, char *word){
+    uint32_t pos[MAX_DEPTH];
+    uint32_t min = UINT32_MAX;
+    int *slot;
+    int i;
+
+    sketchPositions(s, word, pos);
+    for(i = 0; i < s->depth; i++){
+        if(s->counters[pos[i]] < min){
+            min = s->counters[pos[i]];
+        }
+    }
+    s->total++;
+    if(min == UINT32_MAX){
+        return;
+    }
+    min++;
+    for(i = 0; i < s->depth; i++){
+        if(s->counters[pos[i]] < min){
+            s->counters[pos[i]] = min;
+        }
+    }
+
+    slot = hitters_get(&s->table, word);
+    if(slot != NULL){
+        s->heap[*slot].count = min;
+        heapDown(s, *slot);
+    }else if(s->numHitters < s->topK){
+        heapSet(s, s->numHitters, word, min);
+        heapUp(s, s->numHitters++);
+    }else if(min > s->heap[0].count){
+        hitters_remove(&s->table, s->heap[0].word);
+        s->hitterBytes -= strlen(s->heap[0].word) + 1;
+        free(s->heap[0].word);
+        heapSet(s, 0, word, min);
+        heapDown(s, 0);
+    }
+}
+
+/**
+ * This method estimates how many times a word has been added. The
+ * estimate is never less than the true count.
+ *
+ * @param s the sketch.
+ * @param word the word to look up.
+ *
+ * @return the estimated count.
+ */
+unsigned int cmsketch_estimate(cmsketch s, char *word){
+    uint32_t pos[MAX_DEPTH];
+    uint32_t min = UINT32_MAX;
+    int i;
+
+    sketchPositions(s, word, pos);
+    for(i = 0; i < s->depth; i++){
+        if(s->counters[pos[i]] < min){
+            min = s->counters[pos[i]];
+        }
+    }
+    return min;
+}
+
+/**
+ * This method copies the current top K words and their estimated counts
+ * into two arrays, in no particular order. Both arrays must have room for
+ * top_k entries. The words are only valid until the next cmsketch_add or
+ * until the sketch is freed.
+ *
+ * @param s the sketch.
+ * @param words the words are stored here.
+ * @param counts the estimated count of each word is stored here.
+ *
+ * @return the number of words stored.
+ */
+int cmsketch_top(cmsketch s, char **words, unsigned int *counts){
+    int i;
+    for(i = 0; i < s->numHitters; i++){
+        words[i] = s->heap[i].word;
+        counts[i] = s->heap[i].count;
+    }
+    return s->numHitters;
+}
+
+/**
+ * This method prints the shape of the sketch, the memory it uses and the
+ * error bound that holds for the words added so far.
+ *
+ * @param s the sketch.
+ * @param stream the stream to send output to.
+ */
+void cmsketch_print_info(cmsketch s, FILE *stream){
+    size_t counterBytes = (size_t) s->width * s->depth * sizeof(uint32_t);
+    double epsilon = exp(1.0) / s->width;
+    double delta = exp(-s->depth);
+
+    fprintf(stream, "Sketch        : %d rows of %d counters\n", s->depth,
+            s->width);
+    fprintf(stream, "Counters      : %lu bytes\n",
+            (unsigned long) counterBytes);
+    fprintf(stream, "Heavy hitters : %d of %d, %lu bytes\n", s->numHitters,
+            s->topK, (unsigned long) s->hitterBytes);
+    fprintf(stream, "Total         : %lu bytes\n",
+            (unsigned long) (counterBytes + s->hitterBytes));
+    fprintf(stream, "Words counted : %lu\n", s->total);
+    fprintf(stream, "Error bound   : +%.0f (epsilon %.3g) with probability "
+            "%.4g\n", ceil(epsilon * s->total), epsilon, 1.0 - delta);
+}
+
+/**
+ * This method frees the memory used by a sketch.
+ *
+ * @param s the sketch to be freed.
+ */
+void cmsketch_free(cmsketch s){
+    int i;
+    for(i = 0; i < s->numHitters; i++){
+        free(s->heap[i].word);
+    }
+    free(s->heap);
+    hitters_destroy(&s->table);
+    hfree(s->block, s->blockSize);
+    free(s);
+}
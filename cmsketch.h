@@ -0,0 +1,21 @@
+#ifndef CMSKETCH_H_
+#define CMSKETCH_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* The least memory a sketch's counters can use: one row of one cache
+ * line. */
+#define CMSKETCH_MIN_BYTES 64
+
+typedef struct cmsketchrec *cmsketch;
+
+extern cmsketch cmsketch_new(double epsilon, double delta, size_t max_bytes,
+                             int top_k);
+extern void cmsketch_add(cmsketch s, char *word);
+extern unsigned int cmsketch_estimate(cmsketch s, char *word);
+extern int cmsketch_top(cmsketch s, char **words, unsigned int *counts);
+extern void cmsketch_print_info(cmsketch s, FILE *stream);
+extern void cmsketch_free(cmsketch s);
+
+#endif
@@ -1,27 +1,258 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "htable.h"
+#include "htable_gen.h"
 #include "mylib.h"
 #include <string.h>
 
+/* The smallest and largest sizes of a key arena chunk. The largest is a
+ * single 2MB page, so that big tables keep their keys on huge pages. */
+#define MIN_CHUNK_SIZE 4096
+#define MAX_CHUNK_SIZE (2 * 1024 * 1024)
 
+/* A stats entry holding this value means the collisions did not fit in a
+ * byte and are kept in the overflow list instead. */
+#define STATS_ESCAPE 255
+
+/* Identifies a file written by htable_save. */
+#define IMAGE_MAGIC "HTIMAGE1"
+
+
+/**
+ * A chunk of the key arena. The keys are stored one after another,
+ * straight after the chunk header.
+ */
+struct keychunk{
+    struct keychunk *next;
+    size_t size;
+    size_t used;
+};
+
+/**
+ * The number of collisions for an insertion that did not fit in its stats
+ * byte.
+ */
+struct statoverflow{
+    int index;
+    int collisions;
+};
 
 /**
  * htable struct, contains variables for:
  * The number of keys currently in the table, the capcity of the table,
  * the contents of the table (an array of strings), the frequencies of
- * each key, a record of how many collisions occur per insertion, and an enum
- * type which dictates the type of hashing method.
+ * each key, a record of how many collisions occur per insertion, an enum
+ * type which dictates the type of hashing method, and the arena the
+ * key strings are copied into.
+ *
+ * The frequencies start out one byte wide and the whole array is widened
+ * to 16 and then 32 bits the first time a count would overflow. The stats
+ * are only allocated if htable_keep_stats is called, and hold one byte per
+ * insertion; the rare insertions with 255 or more collisions are kept in
+ * the overflow list, in insertion order.
+ *
+ * A table loaded with htable_load is read-only and has no items array:
+ * its slots are the key offsets in the mapped image, which are probed in
+ * place, and its frequencies are the image's too. An overlay table has a
+ * base table that is searched after it, and numShadowed counts the
+ * overlay's keys that are also in the base.
+ *
+ * search, ownSearch and locate are bound by bindSearch to functions
+ * specialised for the table's hashing method and frequency width, so
+ * nothing is decided at run time on the search path. ownSearch ignores
+ * the base; search adds it in for an overlay.
  */
 struct htablerec{
     int numKeys;
     int capacity;
     char **items;
-    int *frequencies;
-    int *stats;
+    void *frequencies;
+    int freqWidth;
+    uint8_t *stats;
+    struct statoverflow *overflow;
+    int numOverflow;
+    int capOverflow;
     hashing_t method;
+    struct keychunk *chunks;
+    size_t chunkSize;
+    htable base;
+    int numShadowed;
+    void *mapping;
+    size_t mappingSize;
+    uint32_t *offsets;
+    char *keys;
+    uint64_t keysSize;
+    int (*search)(htable h, char *word);
+    int (*ownSearch)(htable h, char *word);
+    int (*locate)(htable h, char *word, int *collisions);
+};
+
+/**
+ * The header at the start of a table image. It is followed by capacity
+ * key offsets (0 for an empty slot, otherwise one more than the offset of
+ * the key in the key block), the frequencies at their stored width padded
+ * to a multiple of 8 bytes, and then the key block of '\0' terminated
+ * strings.
+ */
+struct imageheader{
+    char magic[8];
+    int32_t capacity;
+    int32_t numKeys;
+    int32_t method;
+    int32_t freqWidth;
+    uint64_t keysSize;
 };
 
+static void bindSearch(htable h);
+
+/**
+ * Returns the frequency stored at a given index, whatever the current
+ * width of the frequencies array.
+ *
+ * @param h the hash table.
+ * @param i the index.
+ *
+ * @return the frequency.
+ */
+static unsigned int freqGet(htable h, int i){
+    switch(h->freqWidth){
+    case 1:
+        return ((uint8_t *) h->frequencies)[i];
+    case 2:
+        return ((uint16_t *) h->frequencies)[i];
+    default:
+        return ((uint32_t *) h->frequencies)[i];
+    }
+}
+
+/**
+ * Stores a frequency at a given index. The value must fit in the current
+ * width of the frequencies array.
+ *
+ * @param h the hash table.
+ * @param i the index.
+ * @param value the frequency.
+ */
+static void freqSet(htable h, int i, unsigned int value){
+    switch(h->freqWidth){
+    case 1:
+        ((uint8_t *) h->frequencies)[i] = value;
+        break;
+    case 2:
+        ((uint16_t *) h->frequencies)[i] = value;
+        break;
+    default:
+        ((uint32_t *) h->frequencies)[i] = value;
+        break;
+    }
+}
+
+/**
+ * Doubles the width of every frequency, copying the counts into a new
+ * array.
+ *
+ * @param h the hash table.
+ */
+static void freqWiden(htable h){
+    void *old = h->frequencies;
+    int i;
+
+    if(h->freqWidth == 1){
+        uint16_t *wider = halloc(h->capacity * sizeof wider[0]);
+        for(i = 0; i < h->capacity; i++){
+            wider[i] = ((uint8_t *) old)[i];
+        }
+        h->frequencies = wider;
+    }else{
+        uint32_t *wider = halloc(h->capacity * sizeof wider[0]);
+        for(i = 0; i < h->capacity; i++){
+            wider[i] = ((uint16_t *) old)[i];
+        }
+        h->frequencies = wider;
+    }
+    hfree(old, h->capacity * h->freqWidth);
+    h->freqWidth *= 2;
+    bindSearch(h);
+}
+
+/**
+ * Adds one to the frequency at a given index, widening the frequencies
+ * array first if the count would overflow its current width.
+ *
+ * @param h the hash table.
+ * @param i the index.
+ */
+static void freqInc(htable h, int i){
+    unsigned int value = freqGet(h, i);
+    if(h->freqWidth < 4 && value == (1u << (8 * h->freqWidth)) - 1){
+        freqWiden(h);
+    }
+    freqSet(h, i, value + 1);
+}
+
+/**
+ * Records the number of collisions for the insertion of a new key and
+ * counts the key. Nothing is recorded if stats are not being kept.
+ *
+ * @param h the hash table.
+ * @param collisions the number of collisions.
+ */
+static void statsRecord(htable h, int collisions){
+    if(h->stats != NULL){
+        if(collisions < STATS_ESCAPE){
+            h->stats[h->numKeys] = collisions;
+        }else{
+            if(h->numOverflow == h->capOverflow){
+                h->capOverflow = h->capOverflow == 0 ? 16 : h->capOverflow * 2;
+                h->overflow = erealloc(h->overflow,
+                                       h->capOverflow * sizeof h->overflow[0]);
+            }
+            h->overflow[h->numOverflow].index = h->numKeys;
+            h->overflow[h->numOverflow].collisions = collisions;
+            h->numOverflow++;
+            h->stats[h->numKeys] = STATS_ESCAPE;
+        }
+    }
+    h->numKeys++;
+}
+
+/**
+ * Returns the number of collisions recorded for the i'th insertion,
+ * looking in the overflow list (which is sorted by index) if needed.
+ *
+ * @param h the hash table.
+ * @param i the insertion number.
+ *
+ * @return the number of collisions, or 0 if stats are not being kept.
+ */
+static int statsGet(htable h, int i){
+    int low = 0;
+    int high = h->numOverflow - 1;
+
+    if(h->stats == NULL || i >= h->numKeys){
+        return 0;
+    }
+    if(h->stats[i] != STATS_ESCAPE){
+        return h->stats[i];
+    }
+    while(low <= high){
+        int mid = (low + high) / 2;
+        if(h->overflow[mid].index < i){
+            low = mid + 1;
+        }else if(h->overflow[mid].index > i){
+            high = mid - 1;
+        }else{
+            return h->overflow[mid].collisions;
+        }
+    }
+    return STATS_ESCAPE;
+}
+
 
 /**
  * Prints out a line of data from the hash table to reflect the state
@@ -42,13 +273,14 @@ static void print_stats_line(htable h, FILE *stream, int percent_full) {
 
     if (current_entries > 0 && current_entries <= h->numKeys) {
         for (i = 0; i < current_entries; i++) {
-            if (h->stats[i] == 0) {
+            int collisions = statsGet(h, i);
+            if (collisions == 0) {
                 at_home++;
             } 
-            if (h->stats[i] > max_collisions) {
-                max_collisions = h->stats[i];
+            if (collisions > max_collisions) {
+                max_collisions = collisions;
             }
-            average_collisions += h->stats[i];
+            average_collisions += collisions;
         }
     
         fprintf(stream, "%4d %10d %11.1f %10.2f %11d\n", percent_full, 
@@ -77,6 +309,11 @@ static void print_stats_line(htable h, FILE *stream, int percent_full) {
 void htable_print_stats(htable h, FILE *stream, int num_stats) {
     int i;
 
+    if (h->stats == NULL) {
+        fprintf(stream, "No stats were kept for this table.\n");
+        return;
+    }
+
     fprintf(stream, "\n%s\n\n", 
             h->method == LINEAR_P ? "Linear Probing" : "Double Hashing"); 
     fprintf(stream, "Percent   Current    Percent    Average      Maximum\n");
@@ -95,6 +332,10 @@ void htable_print_stats(htable h, FILE *stream, int num_stats) {
  * This method creates and returns a new htable struct.
  * It sets all the variables of the new htable struct to their default values
  * (NULL or 0),  and allocates memory to all the arrays and the object itself.
+ * The arrays are allocated with halloc so that large tables are placed on
+ * huge pages, which cuts the TLB misses caused by probing at random.
+ * The frequencies start one byte wide and no stats are kept until
+ * htable_keep_stats is called.
  * The hashing_t method paramater is to determine what hashing method to use
  * for the new table.
  *
@@ -110,71 +351,136 @@ htable htable_new(int size, hashing_t method){
     result->numKeys = 0;
     result->capacity = size;
     result->method = method;
-    result->items = emalloc(size * sizeof result->items[0]);
-    result->frequencies = emalloc(size * sizeof result->frequencies[0]);
-    result->stats = emalloc(size * sizeof result->stats[0]);
+    result->items = halloc(size * sizeof result->items[0]);
+    result->frequencies = halloc(size * sizeof(uint8_t));
+    result->freqWidth = 1;
+    result->stats = NULL;
+    result->overflow = NULL;
+    result->numOverflow = 0;
+    result->capOverflow = 0;
+    result->chunks = NULL;
+    result->base = NULL;
+    result->numShadowed = 0;
+    result->mapping = NULL;
+    result->mappingSize = 0;
+    result->offsets = NULL;
+    result->keys = NULL;
+    result->keysSize = 0;
+    result->chunkSize = size * sizeof result->items[0];
+    if(result->chunkSize < MIN_CHUNK_SIZE){
+        result->chunkSize = MIN_CHUNK_SIZE;
+    }else if(result->chunkSize > MAX_CHUNK_SIZE){
+        result->chunkSize = MAX_CHUNK_SIZE;
+    }
     for(i = 0; i < size; i++){
         result->items[i] = NULL;
-        result->frequencies[i] = 0;
-        result->stats[i] = 0;
+        freqSet(result, i, 0);
     }
+    bindSearch(result);
     return result;
 }
 
+/**
+ * This method creates an empty table that sits on top of a shared base
+ * table. Words are inserted into the overlay only, and searches check the
+ * overlay and then the base, so the base (typically a large dictionary
+ * loaded with htable_load) is never copied or changed. The overlay uses
+ * the base's hashing method. The base must not itself be an overlay, and
+ * must outlive the overlay; freeing the overlay does not free it.
+ *
+ * @param base the shared table to search after the overlay.
+ * @param size the desired size/capacity of the overlay.
+ *
+ * @return result the overlay that has been created.
+ */
+htable htable_new_overlay(htable base, int size){
+    htable result = htable_new(size, base->method);
+    result->base = base;
+    bindSearch(result);
+    return result;
+}
 
 /**
- * This method first frees all the keys in the keys array of the htable.
- * Then it frees all the arrays in the htable, and finally frees the object
- * itself.
+ * This method starts keeping the collision stats that are shown by
+ * htable_print_stats and htable_print_entire_table. It should be called
+ * before anything is inserted; earlier insertions are shown as having
+ * no collisions.
  *
- * @param h the hash table to be freed.
+ * @param h the hash table.
  */
-void htable_free(htable h){
+void htable_keep_stats(htable h){
     int i;
-    for(i = 0; i < h->capacity; i++){
-        free(h->items[i]);
+    if(h->stats == NULL){
+        h->stats = halloc(h->capacity * sizeof h->stats[0]);
+        for(i = 0; i < h->capacity; i++){
+            h->stats[i] = 0;
+        }
     }
-    free(h->frequencies);
-    free(h->stats);
-    free(h->items);
-    free(h);
 }
 
+
 /**
- * This method prints all the keys of the htable to a given output stream.
+ * This method first frees the key arena that holds all the keys of the
+ * htable. Then it frees all the arrays in the htable, and finally frees
+ * the object itself.
  *
- * @param h the htable that we want to print the keys from.
- * @param f() the function that actually prints values from htable h
- *            to stdout.
+ * @param h the hash table to be freed.
  */
-void htable_print(htable h, void f(int freq, char* word)){
-    int i;
-    for(i = 0; i < h->capacity; i++){
-        if(h->items[i] != NULL) {
-	  f(h->frequencies[i], h->items[i]);
-        }
+void htable_free(htable h){
+    struct keychunk *c, *next;
+    if(h->mapping != NULL){
+        munmap(h->mapping, h->mappingSize);
+        free(h);
+        return;
+    }
+    for(c = h->chunks; c != NULL; c = next){
+        next = c->next;
+        hfree(c, c->size);
     }
+    hfree(h->frequencies, h->capacity * h->freqWidth);
+    if(h->stats != NULL){
+        hfree(h->stats, h->capacity * sizeof h->stats[0]);
+    }
+    free(h->overflow);
+    hfree(h->items, h->capacity * sizeof h->items[0]);
+    free(h);
 }
 
 /**
- * This static method converts a string to an unsigned int.
- * This is used for inserting and searching indeces in the htable.
+ * This static method copies a string into the key arena, starting a new
+ * chunk when the current one is full. Keeping the keys packed together
+ * rather than in separate mallocs means fewer pages are touched when the
+ * probes compare keys.
  *
- * @param word the string to be converted to an unsigned int.
+ * @param h the htable that owns the arena.
+ * @param word the string to be copied.
  *
- * @return result the resulting unsigned int after the string
- * has been converted.
+ * @return the copy of the string.
  */
-static unsigned int wordToInt(char *word){
-    unsigned int result = 0;
-    while(*word != '\0'){
-        result = (*word++ + 31 * result);
+static char *arenaCopy(htable h, char *word){
+    size_t len = strlen(word) + 1;
+    struct keychunk *c = h->chunks;
+    char *result;
+
+    if(c == NULL || c->used + len > c->size){
+        size_t size = h->chunkSize;
+        if(size < sizeof *c + len){
+            size = sizeof *c + len;
+        }
+        c = halloc(size);
+        c->next = h->chunks;
+        c->size = size;
+        c->used = sizeof *c;
+        h->chunks = c;
     }
+    result = (char *) c + c->used;
+    memcpy(result, word, len);
+    c->used += len;
     return result;
 }
 
 /**
- * This static method allocates memory for a string and inserts it
+ * This static method copies a string into the key arena and inserts it
  * at a given index in an htable.
  * This method makes the insertion code a lot cleaner.
  *
@@ -183,80 +489,147 @@ static unsigned int wordToInt(char *word){
  * @param key the index to insert the string at.
  */
 static void htableInsertAt(htable h, char *word, int key){
-    h->items[key] = emalloc(sizeof h->items[key][0] * strlen(word)+1);
-    strcpy(h->items[key], word);
-    h->frequencies[key]++;
+    h->items[key] = arenaCopy(h, word);
+    freqInc(h, key);
 }
 
+/* The probe loops for each hashing method, specialised for string keys
+ * (an empty slot holds NULL) and the word hash from mylib.h. */
+HTABLE_GENERATE(linearProbe, char *, int, word_hash, word_eq, NULL,
+                HTABLE_PROBE_LINEAR)
+HTABLE_GENERATE(doubleHash, char *, int, word_hash, word_eq, NULL,
+                HTABLE_PROBE_DOUBLE)
 
 /**
- * This method uses linear hashing to insert a key into an htable.
- * It iterates based on the linear probing algorithm until it finds either
- * a free cell, a matching string, or has iterated through the entire table.
- * If it finds a free cell, it inserts the given string, increases the numKeys
- * variable of the htable, and sets the stats[numKeys] to the number of
- * collisions that occured during insertion.
- * If it finds a matching string, it increases the key's matching frequency.
- * If it iterates through through the whole table and doesn't find either
- * stopping case, it returns -1 (insertion fail).
+ * These static methods find the slot holding a word, or the empty slot
+ * it would be inserted at, with the probe loop for one hashing method.
+ * They return -1 if the word is not in the table and the table is full,
+ * and store the number of slots probed before the one returned in
+ * collisions.
+ */
+static int linearLocate(htable h, char *word, int *collisions){
+    return linearProbe_locate(h->items, h->capacity, word, collisions);
+}
+
+static int doubleLocate(htable h, char *word, int *collisions){
+    return doubleHash_locate(h->items, h->capacity, word, collisions);
+}
+
+/*
+ * HTABLE_SEARCH(NAME, PROBE, FREQ_T) defines a static method that returns
+ * the frequency of a word (0 if it is not in the table, whose frequency
+ * slot is always 0) using the probe loop PROBE and frequencies of type
+ * FREQ_T, without looking in the table's base.
+ */
+#define HTABLE_SEARCH(NAME, PROBE, FREQ_T)                                  \
+static int NAME(htable h, char *word){                                        \
+    int collisions;                                                           \
+    int key = PROBE##_locate(h->items, h->capacity, word, &collisions);      \
+    return key < 0 ? 0 : ((FREQ_T *) h->frequencies)[key];                   \
+}
+
+HTABLE_SEARCH(linearSearch8, linearProbe, uint8_t)
+HTABLE_SEARCH(linearSearch16, linearProbe, uint16_t)
+HTABLE_SEARCH(linearSearch32, linearProbe, uint32_t)
+HTABLE_SEARCH(doubleSearch8, doubleHash, uint8_t)
+HTABLE_SEARCH(doubleSearch16, doubleHash, uint16_t)
+HTABLE_SEARCH(doubleSearch32, doubleHash, uint32_t)
+
+/**
+ * This static method returns the key in a slot of a table loaded with
+ * htable_load, read from the key offsets in the mapped image. A slot
+ * whose offset is 0, or points outside the key block, is empty.
+ *
+ * @param h the loaded table.
+ * @param i the slot.
  *
- * @param h the htable that the key is to be inserted into.
- * @param word the string to be inserted into the htable.
+ * @return the key, or NULL if the slot is empty.
  */
-static int linearInsert(htable h, char *word){
+static inline char *imageKey(htable h, unsigned int i){
+    uint32_t offset = h->offsets[i];
+    return offset == 0 || offset > h->keysSize ? NULL
+        : h->keys + offset - 1;
+}
 
-    int collisions = 0;
-    int key = wordToInt(word) % h->capacity;
+/* The same probe loops run over the key offsets of a mapped image. */
+HTABLE_GENERATE_LOCATE(linearImage, htable, char *, imageKey, word_hash,
+                       word_eq, NULL, HTABLE_PROBE_LINEAR)
+HTABLE_GENERATE_LOCATE(doubleImage, htable, char *, imageKey, word_hash,
+                       word_eq, NULL, HTABLE_PROBE_DOUBLE)
 
-  
-    if(h->items[key] == NULL){
-        htableInsertAt(h, word, key);
-        h->stats[h->numKeys++] = collisions;
-        return key;
-    }else if(strcmp(h->items[key], word) == 0){
-        h->frequencies[key]++;
-        return key;
-    }
-    collisions = 1;
-    while(collisions < h->capacity + 1){
-        key = ((key + 1) % h->capacity);
-        if(h->items[key] == NULL){
-            htableInsertAt(h, word, key);
-            h->stats[h->numKeys++] = collisions;
-            return key;
-        }else if(strcmp(h->items[key], word) == 0){
-            h->frequencies[key]++;
-            return key;
-        }else{
-            collisions++;
-        }
-    }
-    
-    return -1;
+/*
+ * IMAGE_SEARCH(NAME, PROBE, FREQ_T) defines a static method like
+ * HTABLE_SEARCH for a table loaded with htable_load. The frequency of an
+ * empty slot is not trusted to be 0, since it comes from the image.
+ */
+#define IMAGE_SEARCH(NAME, PROBE, FREQ_T)                                   \
+static int NAME(htable h, char *word){                                        \
+    int collisions;                                                           \
+    int key = PROBE##_locate(h, h->capacity, word, &collisions);             \
+    return key < 0 || imageKey(h, key) == NULL ? 0                            \
+        : ((FREQ_T *) h->frequencies)[key];                                   \
 }
 
+IMAGE_SEARCH(linearImage8, linearImage, uint8_t)
+IMAGE_SEARCH(linearImage16, linearImage, uint16_t)
+IMAGE_SEARCH(linearImage32, linearImage, uint32_t)
+IMAGE_SEARCH(doubleImage8, doubleImage, uint8_t)
+IMAGE_SEARCH(doubleImage16, doubleImage, uint16_t)
+IMAGE_SEARCH(doubleImage32, doubleImage, uint32_t)
+
 /**
- * This method calculates the next step for double hashing.
+ * This static method searches an overlay and then its base, adding the
+ * two frequencies together.
+ *
+ * @param h the overlay to search.
+ * @param word the word to look for.
  *
- * @param h the htable we are working with.
- * @param i_key the unsigned integer key used to calculate the next step.
+ * @return the combined frequency, or 0 if neither table has the word.
+ */
+static int overlaySearch(htable h, char *word){
+    return h->ownSearch(h, word) + h->base->search(h->base, word);
+}
+
+/**
+ * This static method points a table's search functions at the ones for
+ * its hashing method and current frequency width. It is called whenever
+ * either of those, or the table's base, is set.
  *
- * @return an unsigned integer representing the next step.
+ * @param h the hash table.
  */
-static unsigned int htable_step(htable h, unsigned int i_key){
-    return 1 + (i_key % (h->capacity - 1));
+static void bindSearch(htable h){
+    static int (*const searches[2][3])(htable, char *) = {
+        { linearSearch8, linearSearch16, linearSearch32 },
+        { doubleSearch8, doubleSearch16, doubleSearch32 }
+    };
+    static int (*const images[2][3])(htable, char *) = {
+        { linearImage8, linearImage16, linearImage32 },
+        { doubleImage8, doubleImage16, doubleImage32 }
+    };
+    int width = h->freqWidth == 1 ? 0 : h->freqWidth == 2 ? 1 : 2;
+    int method = h->method == LINEAR_P ? 0 : 1;
+
+    if(h->offsets != NULL){
+        /* a loaded table cannot be inserted into, so needs no locate */
+        h->locate = NULL;
+        h->ownSearch = images[method][width];
+    }else{
+        h->locate = method == 0 ? linearLocate : doubleLocate;
+        h->ownSearch = searches[method][width];
+    }
+    h->search = h->base != NULL ? overlaySearch : h->ownSearch;
 }
 
 /**
- * This method uses double hashing to insert a key into a hash table.
- * It iterates based on the double hashing algorithm until it finds either
- * a free cell, a matching string, or has iterated through the entire table.
+ * This method inserts a word into a given hash table h, probing with
+ * linear probing or double hashing depending on the table's method
+ * variable (LINEAR_P for linear probing, DOUBLE_H for double hashing).
  * If it finds a free cell, it inserts the given string, increases the numKeys
- * variable of the htable, and sets the stats[numKeys] to the number of
+ * variable of the htable, and records in stats (if they are kept) the number of
  * collisions that occured during insertion.
  * If it finds a matching string, it increases the key's matching frequency.
- * If it iterates through through the whole table and doesn't find either
- * stopping case, it returns -1 (insertion fail).
+ * If it probes the whole table and doesn't find either, it returns -1
+ * (insertion fail).
  *
  * @param h the hash table to insert into.
  * @param word the word to insert into the hash table.
@@ -264,132 +637,285 @@ static unsigned int htable_step(htable h, unsigned int i_key){
  * @return returns the key if it successfully inserted,
  * returns -1 if it failed.
 */
-static int doubleInsert(htable h, char *word){
-    int collisions = 0;
-    int key = wordToInt(word) % h->capacity;
+int htable_insert(htable h, char *word){
+    int collisions;
+    int key;
+
+    if(h->mapping != NULL){
+        return -1;
+    }
+    key = h->locate(h, word, &collisions);
+    if(key < 0){
+        return -1;
+    }
     if(h->items[key] == NULL){
         htableInsertAt(h, word, key);
-        h->stats[h->numKeys++] = collisions;
-        return key;
-    }else if(strcmp(h->items[key], word) == 0){
-        h->frequencies[key]++;
-        return key;
-    }
-    collisions = 1;
-    while(collisions < h->capacity + 1){
-      key = (key + htable_step(h, wordToInt(word))) % h->capacity;
-        if(h->items[key] == NULL){
-            htableInsertAt(h, word, key);
-            h->stats[h->numKeys++] = collisions;
-            return key;
-        }else if(strcmp(h->items[key], word) == 0){
-            h->frequencies[key]++;
-            return key;
-        }else{
-            collisions++;
+        statsRecord(h, collisions);
+        if(h->base != NULL && h->base->search(h->base, word) > 0){
+            h->numShadowed++;
         }
+    }else{
+        freqInc(h, key);
     }
-    
-    return -1;
+    return key;
 }
 
-
 /**
- * This method uses double hashing to search for a key into a hash table.
- * It iterates based on the double hashing algorithm until it finds either
- * a free cell, a matching string, or has iterated through the entire table.
- * If it finds a free cell, it returns a 0, indicating that the
- * word is not in the table.
- * If it finds a matching string, it increases the key's matching frequency.
- * If it iterates through through the whole table and doesn't find either
- * stopping case, it returns 0 (word is not in the table).
+ * This method searches for a word in a given hash table h, probing with
+ * linear probing or double hashing depending on the table's method
+ * variable (LINEAR_P for linear probing, DOUBLE_H for double hashing).
+ * If h is an overlay, its base is searched as well and the two
+ * frequencies are added together.
  *
- * @param h the hash table to search.
- * @param word the word to insert into.
+ * @param h the hash table to search for the given key.
+ * @param word the key to search for.
  *
  * @return returns the frequencies of the key if it is found, returns 0
  * if the key is not found.
 */
-static int doubleSearch(htable h, char *word){
-    int key = wordToInt(word) % h->capacity;
-    int collisions = 0;
-    while((h->items[key] != NULL) && strcmp(h->items[key], word) != 0
-	  && collisions < h->capacity){
-        collisions++;
-        key = (key + htable_step(h, wordToInt(word))) % h->capacity;
-	
-    }
-    if(collisions >= h->capacity){
-        return 0;
-    }else{
-        return h->frequencies[key];
-    }
-    return 0;
+int htable_search(htable h, char *word){
+    return h->search(h, word);
 }
 
 /**
- * This method uses double hashing to search for a key into a hash table.
- * It iterates based on the linear probing algorithm until it finds either
- * a free cell, a matching string, or has iterated through the entire table.
- * If it finds a free cell, it returns a 0, indicating that the
- * word is not in the table.
- * If it finds a matching string, it increases the key's matching frequency.
- * If it iterates through through the whole table and doesn't find either
- * stopping case, it returns 0 (word is not in the table).
- 
- * @param h the hash table to search for the given key.
- * @param key the key to search for.
- 
- * @return returns the frequencies of the key if it is found, returns 0
- * if the key is not found.
-*/
-static int linearSearch(htable h, char *key){
-    int collisions = 0;
-    int pos = wordToInt(key) % h->capacity;
+ * This static method returns the key in a slot of a table, whether it is
+ * in the items array or, for a loaded table, in the mapped image.
+ *
+ * @param h the hash table.
+ * @param i the slot.
+ *
+ * @return the key, or NULL if the slot is empty.
+ */
+static char *slotKey(htable h, int i){
+    return h->offsets == NULL ? h->items[i] : imageKey(h, i);
+}
 
-    while(h->items[pos] != NULL &&
-          (strcmp(key, h->items[pos]) != 0) &&  collisions < h->capacity) {
-        pos = ((pos + 1) % h->capacity);
-        collisions++;
+/**
+ * This method prints all the keys of the htable to a given output stream.
+ * For an overlay, the keys of the base are printed first (with the
+ * overlay's count added), followed by the keys only the overlay has.
+ *
+ * @param h the htable that we want to print the keys from.
+ * @param f() the function that actually prints values from htable h
+ *            to stdout.
+ */
+void htable_print(htable h, void f(int freq, char* word)){
+    htable base = h->base;
+    char *key;
+    int i;
+    if(base != NULL){
+        for(i = 0; i < base->capacity; i++){
+            if((key = slotKey(base, i)) != NULL){
+                f(freqGet(base, i) + h->ownSearch(h, key), key);
+            }
+        }
     }
-    if(collisions == h->capacity){
-        return 0;
-    }else{
-        return h->frequencies[pos];
+    for(i = 0; i < h->capacity; i++){
+        if((key = slotKey(h, i)) != NULL &&
+           (base == NULL || base->search(base, key) == 0)) {
+	  f(freqGet(h, i), key);
+        }
     }
-    return 0;
 }
 
+/**
+ * This method returns the number of keys in the htable, including the
+ * keys of its base if it is an overlay. For a loaded table this is the
+ * number recorded in the image.
+ *
+ * @param h the htable.
+ *
+ * @return the number of keys.
+ */
+int htable_num_keys(htable h){
+    if(h->base != NULL){
+        return h->numKeys - h->numShadowed + h->base->numKeys;
+    }
+    return h->numKeys;
+}
 
 /**
- * This method uses either the linearInsert method or the doubleInsert method
- * to insert a word into a given hash table h, based on that hash table's
- * method variable (LINEAR_P for linear probing, DOUBLE_H for double hashing).
+ * This method copies every key of the htable and its frequency into two
+ * arrays, in the order htable_print visits them. Both arrays must have
+ * room for htable_num_keys(h) entries, and no more than that are stored
+ * even if a damaged image has more keys than it says. The words are not
+ * copied, so they are only valid until the htable is freed.
  *
- * @param h the hash table to insert into.
- * @param word the word to insert into the hash table.
-*/
-int htable_insert(htable h, char *word){
-    if(h->method == LINEAR_P){
-        return linearInsert(h, word);
-    }else{
-        return doubleInsert(h, word);
+ * @param h the htable to collect the keys from.
+ * @param words the keys are stored here.
+ * @param freqs the frequency of each key is stored here.
+ *
+ * @return the number of keys stored.
+ */
+int htable_collect(htable h, char **words, unsigned int *freqs){
+    htable base = h->base;
+    int limit = htable_num_keys(h);
+    char *key;
+    int i;
+    int n = 0;
+    if(base != NULL){
+        for(i = 0; i < base->capacity && n < limit; i++){
+            if((key = slotKey(base, i)) != NULL){
+                words[n] = key;
+                freqs[n] = freqGet(base, i) + h->ownSearch(h, key);
+                n++;
+            }
+        }
+    }
+    for(i = 0; i < h->capacity && n < limit; i++){
+        if((key = slotKey(h, i)) != NULL &&
+           (base == NULL || base->search(base, key) == 0)){
+            words[n] = key;
+            freqs[n] = freqGet(h, i);
+            n++;
+        }
     }
+    return n;
 }
 
 /**
- * This method uses either the linearInsert method or the doubleInsert method
- * to search for a word into a given hash table h, based on that hash table's
- * method variable (LINEAR_P for linear probing, DOUBLE_H for double hashing).
- * @param h the hash table to search for the given key.
- * @param key the key to search for.
-*/
-int htable_search(htable h, char *word){
-    if(h->method == LINEAR_P){
-        return linearSearch(h, word);
-    }else{
-        return doubleSearch(h, word);
+ * This method writes the table to a file as an image that htable_load can
+ * map straight into memory. Only the keys and frequencies are saved; for
+ * an overlay that means only the overlay's own keys.
+ *
+ * @param h the hash table to save.
+ * @param filename the name of the file to write.
+ *
+ * @return 0 on success, -1 if the file could not be written.
+ */
+int htable_save(htable h, char *filename){
+    struct imageheader header;
+    FILE *stream = fopen(filename, "wb");
+    uint32_t offset;
+    uint64_t keysSize = 0;
+    size_t freqs = h->capacity * (size_t) h->freqWidth;
+    char pad[8] = {0};
+    char *key;
+    int i;
+
+    if(stream == NULL){
+        return -1;
+    }
+    for(i = 0; i < h->capacity; i++){
+        if((key = slotKey(h, i)) != NULL){
+            keysSize += strlen(key) + 1;
+        }
+    }
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, IMAGE_MAGIC, sizeof header.magic);
+    header.capacity = h->capacity;
+    header.numKeys = h->numKeys;
+    header.method = h->method;
+    header.freqWidth = h->freqWidth;
+    header.keysSize = keysSize;
+    fwrite(&header, sizeof header, 1, stream);
+
+    keysSize = 0;
+    for(i = 0; i < h->capacity; i++){
+        offset = 0;
+        if((key = slotKey(h, i)) != NULL){
+            offset = keysSize + 1;
+            keysSize += strlen(key) + 1;
+        }
+        fwrite(&offset, sizeof offset, 1, stream);
+    }
+    fwrite(h->frequencies, 1, freqs, stream);
+    fwrite(pad, 1, (8 - (h->capacity * sizeof offset + freqs) % 8) % 8,
+           stream);
+    for(i = 0; i < h->capacity; i++){
+        if((key = slotKey(h, i)) != NULL){
+            fwrite(key, 1, strlen(key) + 1, stream);
+        }
+    }
+    if(ferror(stream)){
+        fclose(stream);
+        return -1;
     }
+    return fclose(stream) == 0 ? 0 : -1;
+}
+
+/**
+ * This method maps a table image written by htable_save into memory,
+ * read-only and shared with any other process that maps the same file.
+ * Nothing is copied or built: the key offsets, keys and frequencies are
+ * all used in place, so loading takes the same time and private memory
+ * whatever the size of the image. Only the header is checked here,
+ * including that the offsets, frequencies and key block it describes
+ * exactly fill the file; a damaged slot is treated as empty when it is
+ * read. The table cannot be
+ * inserted into, but it can be searched, printed and used as the base of
+ * overlays.
+ *
+ * @param filename the name of the image file.
+ *
+ * @return result the loaded table, or NULL if the file could not be
+ * mapped or is not a valid image.
+ */
+htable htable_load(char *filename){
+    struct imageheader header;
+    struct stat st;
+    size_t freqs, keysStart;
+    htable result;
+    void *mapping;
+    int fd = open(filename, O_RDONLY);
+
+    if(fd < 0){
+        return NULL;
+    }
+    if(fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof header){
+        close(fd);
+        return NULL;
+    }
+    mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED){
+        return NULL;
+    }
+    memcpy(&header, mapping, sizeof header);
+    if(memcmp(header.magic, IMAGE_MAGIC, sizeof header.magic) != 0
+       || header.capacity < 2
+       || header.numKeys < 0 || header.numKeys > header.capacity
+       || (header.method != LINEAR_P && header.method != DOUBLE_H)
+       || (header.freqWidth != 1 && header.freqWidth != 2
+           && header.freqWidth != 4)){
+        munmap(mapping, st.st_size);
+        return NULL;
+    }
+    /* the offsets and frequencies must fit in the file before the key
+     * block's size is checked, or a huge capacity could wrap the sum */
+    freqs = (size_t) header.capacity * header.freqWidth;
+    keysStart = sizeof header + header.capacity * sizeof(uint32_t) + freqs;
+    keysStart += (8 - (keysStart - sizeof header) % 8) % 8;
+    if(keysStart > (size_t) st.st_size
+       || header.keysSize != (size_t) st.st_size - keysStart
+       || (header.keysSize > 0
+           && ((char *) mapping)[st.st_size - 1] != '\0')){
+        munmap(mapping, st.st_size);
+        return NULL;
+    }
+
+    result = emalloc(sizeof *result);
+    result->numKeys = header.numKeys;
+    result->capacity = header.capacity;
+    result->method = header.method;
+    result->items = NULL;
+    result->offsets = (uint32_t *) ((char *) mapping + sizeof header);
+    result->keys = (char *) mapping + keysStart;
+    result->keysSize = header.keysSize;
+    result->frequencies = result->offsets + header.capacity;
+    result->freqWidth = header.freqWidth;
+    result->stats = NULL;
+    result->overflow = NULL;
+    result->numOverflow = 0;
+    result->capOverflow = 0;
+    result->chunks = NULL;
+    result->chunkSize = 0;
+    result->base = NULL;
+    result->numShadowed = 0;
+    result->mapping = mapping;
+    result->mappingSize = st.st_size;
+    bindSearch(result);
+    return result;
 }
 
 /**
@@ -401,15 +927,125 @@ int htable_search(htable h, char *word){
  */
 
 void htable_print_entire_table(htable h, FILE *stream) {
+    char *key;
     int i;
     fprintf(stream, "  Pos  Freq  Stats  Word\n");
     fprintf(stream, "----------------------------------------\n");
     for (i=0; i<h->capacity; i++) {
-      if (h->items[i]==NULL) {
-        fprintf(stream, "%5d %5d %5d\n", i, h->frequencies[i], h->stats[i]);
+      if ((key = slotKey(h, i))==NULL) {
+        fprintf(stream, "%5d %5u %5d\n", i, freqGet(h, i), statsGet(h, i));
       } else {
-        fprintf(stream, "%5d %5d %5d   %s\n",i, h->frequencies[i], h->stats[i], h->items[i]);
+        fprintf(stream, "%5d %5u %5d   %s\n",i, freqGet(h, i), statsGet(h, i), key);
       }  
     }
 
 }
+
+/**
+ * This static function works out the memory a table uses that is private
+ * to this process, leaving out any mapped image.
+ *
+ * @param h the hashtable.
+ * @param keys the size of the key arena is stored here.
+ *
+ * @return the number of bytes.
+ */
+
+static size_t privateBytes(htable h, size_t *keys) {
+    size_t total = sizeof *h;
+    struct keychunk *c;
+
+    *keys = 0;
+    for (c = h->chunks; c != NULL; c = c->next) {
+        *keys += c->size;
+    }
+    total += *keys;
+    if (h->items != NULL) {
+        total += h->capacity * sizeof h->items[0];
+    }
+    if (h->mapping == NULL) {
+        total += h->capacity * (size_t) h->freqWidth;
+    }
+    if (h->stats != NULL) {
+        total += h->capacity * sizeof h->stats[0]
+            + h->capOverflow * sizeof h->overflow[0];
+    }
+    return total;
+}
+
+/**
+ * This static function works out the memory a table would use if it
+ * stored a pointer, an int frequency and an int stat for every slot, as
+ * well as its keys. A loaded table's keys are the key block of its image.
+ *
+ * @param h the hashtable.
+ *
+ * @return the number of bytes.
+ */
+
+static size_t intCounterBytes(htable h) {
+    size_t keys;
+
+    privateBytes(h, &keys);
+    if (h->mapping != NULL) {
+        keys += h->keysSize;
+    }
+    return h->capacity * (sizeof(char *) + 2 * sizeof(int)) + keys;
+}
+
+/**
+ * This function prints how much memory the hash table is using, and the
+ * bytes per key compared with storing a pointer, an int frequency and an
+ * int stat for every slot. A loaded table's keys and frequencies are in
+ * its mapped image, which is shared with any other process using it, so
+ * they are shown apart from the private total. An overlay also shows the
+ * memory of its base, and the totals and bytes per key cover both tables
+ * and all of their keys.
+ *
+ * @param h the hashtable to report on.
+ * @param stream the stream to send output to.
+ */
+
+void htable_print_memory(htable h, FILE *stream) {
+    size_t items = h->items != NULL ? h->capacity * sizeof h->items[0] : 0;
+    size_t freqs = h->mapping == NULL ? h->capacity * (size_t) h->freqWidth
+        : 0;
+    size_t stats = 0;
+    size_t keys, baseKeys;
+    size_t total = privateBytes(h, &keys);
+    size_t before = intCounterBytes(h);
+    int n = htable_num_keys(h) > 0 ? htable_num_keys(h) : 1;
+
+    if (h->stats != NULL) {
+        stats = h->capacity * sizeof h->stats[0]
+            + h->capOverflow * sizeof h->overflow[0];
+    }
+
+    fprintf(stream, "Keys          : %d in %d slots\n", h->numKeys,
+            h->capacity);
+    fprintf(stream, "Items         : %lu bytes\n", (unsigned long) items);
+    fprintf(stream, "Frequencies   : %lu bytes (%d bit)\n",
+            (unsigned long) freqs, h->freqWidth * 8);
+    fprintf(stream, "Stats         : %lu bytes%s\n", (unsigned long) stats,
+            h->stats == NULL ? " (not kept)" : "");
+    fprintf(stream, "Key arena     : %lu bytes\n", (unsigned long) keys);
+    if (h->mapping != NULL) {
+        fprintf(stream, "Mapped image  : %lu bytes (shared)\n",
+                (unsigned long) h->mappingSize);
+    }
+    if (h->base != NULL) {
+        size_t basePrivate = privateBytes(h->base, &baseKeys);
+        fprintf(stream, "Base table    : %d keys, %lu bytes private, "
+                "%lu bytes mapped (shared)\n", h->base->numKeys,
+                (unsigned long) basePrivate,
+                (unsigned long) h->base->mappingSize);
+        total += basePrivate;
+        before += intCounterBytes(h->base);
+    }
+    fprintf(stream, "Total         : %lu bytes private, %.1f bytes/key\n",
+            (unsigned long) total, (double) total / n);
+    fprintf(stream, "Int counters  : %lu bytes, %.1f bytes/key\n",
+            (unsigned long) before, (double) before / n);
+    fprintf(stream, "Saving        : %.1f bytes/key\n",
+            ((double) before - total) / n);
+}
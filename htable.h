@@ -8,11 +8,18 @@ typedef struct htablerec *htable;
 typedef enum hashing_e { LINEAR_P, DOUBLE_H} hashing_t;
 
 extern htable htable_new(int tableSize, hashing_t method);
+extern htable htable_new_overlay(htable base, int tableSize);
+extern htable htable_load(char *filename);
+extern int htable_save(htable h, char *filename);
+extern void htable_keep_stats(htable h);
 extern int htable_insert(htable h, char *item);
 extern int htable_search(htable h, char *item);
 extern void htable_print(htable h, void f(int freq, char* word));
+extern int htable_num_keys(htable h);
+extern int htable_collect(htable h, char **words, unsigned int *freqs);
 extern void htable_free(htable h);
 extern void htable_print_entire_table(htable h, FILE *stream);
 extern void htable_print_stats(htable h, FILE *stream, int num_stats);
+extern void htable_print_memory(htable h, FILE *stream);
 
 #endif
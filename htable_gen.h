@@ -0,0 +1,185 @@
+#ifndef HTABLE_GEN_H_
+#define HTABLE_GEN_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include "mylib.h"
+
+/*
+ * Open addressing hash tables specialised at compile time.
+ *
+ * HTABLE_GENERATE(NAME, KEY_T, VAL_T, HASH, EQ, EMPTY, PROBE) defines a
+ * table type struct NAME and static inline functions for it, with the
+ * hash, key comparison and probing policy expanded straight into the
+ * probe loop instead of being chosen at run time:
+ *
+ *   HASH(key)      returns an unsigned int hash of a key.
+ *   EQ(a, b)       is non-zero if two keys are equal.
+ *   EMPTY          is the key value that marks an empty slot. Keys are
+ *                  compared with it using ==, so KEY_T must be a scalar
+ *                  or pointer type.
+ *   PROBE(h, cap)  gives the step between probes for a key with hash h;
+ *                  use HTABLE_PROBE_LINEAR or HTABLE_PROBE_DOUBLE.
+ *
+ * The functions defined are:
+ *
+ *   NAME_locate(keys, capacity, key, &collisions)
+ *       finds the slot in a key array holding key, or the empty slot it
+ *       would be inserted at, or returns -1 if neither exists. This is
+ *       the probe loop, and can be used on key arrays owned by another
+ *       structure (as htable does).
+ *   NAME_init(&t, capacity), NAME_destroy(&t)
+ *       allocate and free a table's arrays. Keys are stored as given,
+ *       so the caller still owns anything they point to.
+ *   NAME_get(&t, key)
+ *       returns a pointer to key's value, or NULL if key is not present.
+ *   NAME_put(&t, key)
+ *       returns a pointer to key's value, inserting key with a zeroed
+ *       value if needed, or NULL if the table is full.
+ *
+ * Double hashing needs a prime capacity so that every slot is visited.
+ *
+ * HTABLE_GENERATE_LOCATE(NAME, SLOTS_T, KEY_T, KEY_AT, HASH, EQ, EMPTY,
+ * PROBE) defines only
+ *
+ *   NAME_locate(slots, capacity, key, &collisions)
+ *       the same probe loop over slots of any type SLOTS_T, where
+ *       KEY_AT(slots, pos) gives the key in a slot (or EMPTY). This lets
+ *       the loop run over keys that are not stored as an array of KEY_T,
+ *       such as the offsets in a mapped image. HTABLE_GENERATE uses it
+ *       with HTABLE_KEY_AT_ARRAY.
+ *
+ * HTABLE_GENERATE_REMOVE(NAME, KEY_T, HASH, EMPTY) adds
+ *
+ *   NAME_remove(&t, key)
+ *       removes key and its value, returning 1 if it was present. The
+ *       keys after it in the same cluster are shifted back, so no
+ *       tombstones are left. A full table is one cluster, so at most
+ *       capacity - 1 keys are looked at. This only works for tables
+ *       generated with HTABLE_PROBE_LINEAR.
+ */
+
+#define HTABLE_PROBE_LINEAR(h, cap) 1u
+#define HTABLE_PROBE_DOUBLE(h, cap) (1u + (h) % ((unsigned int) (cap) - 1))
+
+#define HTABLE_KEY_AT_ARRAY(keys, pos) ((keys)[pos])
+
+#define HTABLE_GENERATE_LOCATE(NAME, SLOTS_T, KEY_T, KEY_AT, HASH, EQ, EMPTY, \
+                               PROBE)                                         \
+                                                                              \
+static inline int NAME##_locate(SLOTS_T slots, int capacity, KEY_T key,       \
+                                int *collisions){                             \
+    unsigned int h = HASH(key);                                               \
+    unsigned int cap = capacity;                                              \
+    unsigned int pos = h % cap;                                               \
+    unsigned int step = 0;                                                    \
+    int c = 0;                                                                \
+    KEY_T k;                                                                  \
+                                                                              \
+    for(;;){                                                                  \
+        k = KEY_AT(slots, pos);                                               \
+        if(k == (EMPTY) || EQ(k, key)){                                       \
+            *collisions = c;                                                  \
+            return pos;                                                       \
+        }                                                                     \
+        if(++c >= capacity){                                                  \
+            break;                                                            \
+        }                                                                     \
+        /* the step is only worked out after the first collision, so */       \
+        /* a table with one slot never divides by capacity - 1 */             \
+        if(c == 1){                                                           \
+            step = PROBE(h, cap);                                             \
+        }                                                                     \
+        pos += step;                                                          \
+        if(pos >= cap){                                                       \
+            pos -= cap;                                                       \
+        }                                                                     \
+    }                                                                         \
+    *collisions = c;                                                          \
+    return -1;                                                                \
+}
+
+#define HTABLE_GENERATE(NAME, KEY_T, VAL_T, HASH, EQ, EMPTY, PROBE)          \
+                                                                              \
+struct NAME {                                                                 \
+    int capacity;                                                             \
+    int num_keys;                                                             \
+    KEY_T *keys;                                                              \
+    VAL_T *vals;                                                              \
+};                                                                            \
+                                                                              \
+HTABLE_GENERATE_LOCATE(NAME, KEY_T const *, KEY_T, HTABLE_KEY_AT_ARRAY, HASH, \
+                       EQ, EMPTY, PROBE)                                      \
+                                                                              \
+static inline void NAME##_init(struct NAME *t, int capacity){                 \
+    int i;                                                                    \
+    t->capacity = capacity;                                                   \
+    t->num_keys = 0;                                                          \
+    t->keys = emalloc(capacity * sizeof t->keys[0]);                          \
+    t->vals = emalloc(capacity * sizeof t->vals[0]);                          \
+    for(i = 0; i < capacity; i++){                                            \
+        t->keys[i] = (EMPTY);                                                 \
+    }                                                                         \
+}                                                                             \
+                                                                              \
+static inline void NAME##_destroy(struct NAME *t){                            \
+    free(t->keys);                                                            \
+    free(t->vals);                                                            \
+}                                                                             \
+                                                                              \
+static inline VAL_T *NAME##_get(struct NAME *t, KEY_T key){                   \
+    int collisions;                                                           \
+    int pos = NAME##_locate(t->keys, t->capacity, key, &collisions);          \
+    if(pos < 0 || t->keys[pos] == (EMPTY)){                                   \
+        return NULL;                                                          \
+    }                                                                         \
+    return &t->vals[pos];                                                     \
+}                                                                             \
+                                                                              \
+static inline VAL_T *NAME##_put(struct NAME *t, KEY_T key){                   \
+    int collisions;                                                           \
+    int pos = NAME##_locate(t->keys, t->capacity, key, &collisions);          \
+    if(pos < 0){                                                              \
+        return NULL;                                                          \
+    }                                                                         \
+    if(t->keys[pos] == (EMPTY)){                                              \
+        t->keys[pos] = key;                                                   \
+        memset(&t->vals[pos], 0, sizeof t->vals[pos]);                        \
+        t->num_keys++;                                                        \
+    }                                                                         \
+    return &t->vals[pos];                                                     \
+}
+
+#define HTABLE_GENERATE_REMOVE(NAME, KEY_T, HASH, EMPTY)                      \
+                                                                              \
+static inline int NAME##_remove(struct NAME *t, KEY_T key){                   \
+    unsigned int cap = t->capacity;                                           \
+    unsigned int hole, pos, home, n;                                          \
+    int collisions;                                                           \
+    int found = NAME##_locate(t->keys, t->capacity, key, &collisions);        \
+                                                                              \
+    if(found < 0 || t->keys[found] == (EMPTY)){                               \
+        return 0;                                                             \
+    }                                                                         \
+    hole = found;                                                             \
+    /* the cluster ends at an empty slot, or back at the removed key's */     \
+    /* slot if the table is full */                                           \
+    for(pos = hole + 1 < cap ? hole + 1 : 0, n = 1;                           \
+        n < cap && t->keys[pos] != (EMPTY);                                   \
+        pos = pos + 1 < cap ? pos + 1 : 0, n++){                              \
+        home = HASH(t->keys[pos]) % cap;                                      \
+        /* a key can fill the hole if its home slot is not between the */    \
+        /* hole and where it is now */                                        \
+        if((pos > hole && (home <= hole || home > pos)) ||                    \
+           (pos < hole && home <= hole && home > pos)){                       \
+            t->keys[hole] = t->keys[pos];                                     \
+            t->vals[hole] = t->vals[pos];                                     \
+            hole = pos;                                                       \
+        }                                                                     \
+    }                                                                         \
+    t->keys[hole] = (EMPTY);                                                  \
+    t->num_keys--;                                                            \
+    return 1;                                                                 \
+}
+
+#endif
@@ -2,6 +2,21 @@
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+/* Allocations at least this big are mapped directly so that they can be
+ * placed on 2MB huge pages. */
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+/* Whether halloc tries to use huge pages, and how many bytes it has
+ * mapped with hugetlbfs pages, with transparent huge pages and with
+ * normal pages. */
+static int use_huge_pages = 1;
+static size_t hugetlb_bytes = 0;
+static size_t thp_bytes = 0;
+static size_t normal_bytes = 0;
 
 
 /** 
@@ -35,7 +50,148 @@ void *erealloc(void *obj, size_t s){
     return result;
 }
 
+/**
+ * This function allocates memory that large, randomly accessed arrays
+ * can live in. Requests of at least 2MB are rounded up to a whole number
+ * of 2MB pages and mapped directly: first from the hugetlbfs pool, then
+ * (if the pool is empty or not configured) as 2MB aligned memory marked
+ * with MADV_HUGEPAGE so the kernel can back it with transparent huge
+ * pages. Once huge pages have been turned off, big requests are marked
+ * with MADV_NOHUGEPAGE instead, so that they stay on normal pages even
+ * when transparent huge pages are always on. Smaller requests use
+ * emalloc. The memory is not cleared.
+ * @param s - the amount of memory in bytes needed.
+ * @return - a pointer to a chunk of memory, which must be freed with
+ *           hfree using the same size.
+ */
+
+void *halloc(size_t s){
+    size_t size = (s + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    char *result;
+    char *aligned;
+
+    if(s < HUGE_PAGE_SIZE){
+        return emalloc(s);
+    }
+    if(use_huge_pages){
+        result = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(result != MAP_FAILED){
+            hugetlb_bytes += size;
+            return result;
+        }
+    }
+    /* map an extra huge page so the result can be moved up to a 2MB
+     * boundary, then give back the unused ends */
+    result = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(result == MAP_FAILED){
+        fprintf(stderr, "Memory alloc failed.\n");
+        exit(EXIT_FAILURE);
+    }
+    aligned = (char *) (((size_t) result + HUGE_PAGE_SIZE - 1)
+                        & ~(HUGE_PAGE_SIZE - 1));
+    if(aligned > result){
+        munmap(result, aligned - result);
+    }
+    munmap(aligned + size, result + HUGE_PAGE_SIZE - aligned);
+    if(use_huge_pages && madvise(aligned, size, MADV_HUGEPAGE) == 0){
+        thp_bytes += size;
+    }else{
+        if(!use_huge_pages){
+            madvise(aligned, size, MADV_NOHUGEPAGE);
+        }
+        normal_bytes += size;
+    }
+    return aligned;
+}
+
+/**
+ * This function frees memory allocated by halloc.
+ * @param p - a pointer returned by halloc.
+ * @param s - the size that was passed to halloc.
+ */
+
+void hfree(void *p, size_t s){
+    if(s < HUGE_PAGE_SIZE){
+        free(p);
+    }else if(p != NULL){
+        munmap(p, (s + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+    }
+}
+
+/**
+ * This function turns huge pages on or off for later calls to halloc.
+ * They are on by default.
+ * @param enable - non-zero to try huge pages, zero to use normal pages.
+ */
+
+void halloc_use_huge_pages(int enable){
+    use_huge_pages = enable;
+}
+
+/**
+ * This function returns the system's transparent huge page mode, the
+ * setting shown in brackets in
+ * /sys/kernel/mm/transparent_hugepage/enabled.
+ * @return - "always", "madvise", "never", or "unknown" if it cannot be
+ *           read.
+ */
+
+char *halloc_thp_mode(void){
+    static char mode[16];
+    char line[128];
+    char *start, *end;
+    FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+
+    strcpy(mode, "unknown");
+    if(f == NULL){
+        return mode;
+    }
+    if(fgets(line, sizeof line, f) != NULL
+       && (start = strchr(line, '[')) != NULL
+       && (end = strchr(start, ']')) != NULL
+       && (size_t) (end - start - 1) < sizeof mode){
+        memcpy(mode, start + 1, end - start - 1);
+        mode[end - start - 1] = '\0';
+    }
+    fclose(f);
+    return mode;
+}
+
+/**
+ * This function prints how much memory halloc has mapped with each kind
+ * of page. Transparent huge pages are only a request, so the kernel may
+ * still have used normal pages for some of that memory.
+ * @param stream - a stream to print the data to.
+ */
+
+void halloc_report(FILE *stream){
+    fprintf(stream, "THP mode        : %s\n", halloc_thp_mode());
+    fprintf(stream, "hugetlbfs pages : %lu bytes\n",
+            (unsigned long) hugetlb_bytes);
+    fprintf(stream, "MADV_HUGEPAGE   : %lu bytes\n",
+            (unsigned long) thp_bytes);
+    fprintf(stream, "normal pages    : %lu bytes\n",
+            (unsigned long) normal_bytes);
+}
+
+/**
+ * This function returns the current time in seconds from a monotonic
+ * clock, for timing work that runs on more than one thread or that
+ * waits, which clock() does not measure.
+ * @return - the time in seconds.
+ */
+
+double now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 /** This function extracts a word from a stdin filestream.
+ * The stream is locked once for the whole word rather than once for every
+ * character, which matters once the program has started other threads.
  * @param s - a pointer to a character string. The word is copied into this
  *           string.
  * @param limit - the size of the character string.
@@ -49,16 +205,18 @@ int getword(char *s, int limit, FILE *stream) {
     char *w = s;
     assert(limit > 0 && s != NULL && stream != NULL);
 
+    flockfile(stream);
     /* skip to the start of the word */
-    while (!isalnum(c = getc(stream)) && EOF != c);
+    while (!isalnum(c = getc_unlocked(stream)) && EOF != c);
 
     if (EOF == c) {
+        funlockfile(stream);
         return EOF;
     } else if (--limit > 0) { /* reduce limit by 1 to allow for the \0 */
         *w++ = tolower(c);
     }
     while (--limit > 0) {
-        if (isalnum(c = getc(stream))) {
+        if (isalnum(c = getc_unlocked(stream))) {
             *w++ = tolower(c);
         } else if ('\'' == c) {
             limit++;
@@ -66,7 +224,48 @@ int getword(char *s, int limit, FILE *stream) {
             break;
         }
     }
+    funlockfile(stream);
     *w = '\0';
     return w - s;
 }
 
+/** This function extracts a word from a string in the same way getword
+ * does from a stream: words are made of letters and digits, folded to
+ * lower case, with apostrophes dropped.
+ * @param s - a pointer to a character string. The word is copied into this
+ *           string.
+ * @param limit - the size of the character string.
+ * @param text - a pointer to the position in the string to read from,
+ *               which is moved past the word.
+ * @return - the word size in bytes or EOF if there are no more words.
+ */
+
+int sgetword(char *s, int limit, char **text) {
+    char *p = *text;
+    char *w = s;
+    assert(limit > 0 && s != NULL && text != NULL);
+
+    /* skip to the start of the word */
+    while (*p != '\0' && !isalnum((unsigned char) *p)) {
+        p++;
+    }
+    if (*p == '\0') {
+        *text = p;
+        return EOF;
+    } else if (--limit > 0) { /* reduce limit by 1 to allow for the \0 */
+        *w++ = tolower((unsigned char) *p++);
+    }
+    while (--limit > 0) {
+        if (isalnum((unsigned char) *p)) {
+            *w++ = tolower((unsigned char) *p++);
+        } else if ('\'' == *p) {
+            p++;
+            limit++;
+        } else {
+            break;
+        }
+    }
+    *text = p;
+    *w = '\0';
+    return w - s;
+}
@@ -3,11 +3,33 @@
 
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 #include "htable.h"
 
 extern void *emalloc(size_t);
 extern void *erealloc(void *, size_t);
+extern void *halloc(size_t);
+extern void hfree(void *, size_t);
+extern void halloc_use_huge_pages(int);
+extern void halloc_report(FILE *);
+extern char *halloc_thp_mode(void);
 extern int getword(char *s, int limit, FILE *stream);
+extern int sgetword(char *s, int limit, char **text);
+extern double now(void);
 
+/* The hash and comparison for every table keyed by words, so that they
+ * all agree on where a word goes. They are inline so that the probe
+ * loops generated by htable_gen.h can expand them. */
+static inline unsigned int word_hash(const char *word){
+    unsigned int result = 0;
+    while(*word != '\0'){
+        result = (*word++ + 31 * result);
+    }
+    return result;
+}
+
+static inline int word_eq(const char *a, const char *b){
+    return strcmp(a, b) == 0;
+}
 
 #endif
@@ -0,0 +1,187 @@
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "mylib.h"
+#include "perfctr.h"
+
+#define CACHE_EVENT(cache, op, result) \
+    ((cache) | ((op) << 8) | ((result) << 16))
+
+/**
+ * The hardware events that are counted, and the names they are printed
+ * with.
+ */
+static const struct {
+    char *name;
+    unsigned int type;
+    unsigned long long config;
+} events[] = {
+    { "cycles",        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "L1d misses",    PERF_TYPE_HW_CACHE,
+      CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                  PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    { "LLC misses",    PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { "branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { "dTLB misses",   PERF_TYPE_HW_CACHE,
+      CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+                  PERF_COUNT_HW_CACHE_RESULT_MISS) }
+};
+
+#define NUM_EVENTS ((int) (sizeof events / sizeof events[0]))
+
+/**
+ * perfctr struct, contains a file descriptor for each event (-1 if the
+ * event could not be opened) and the reason the first event that failed
+ * could not be opened.
+ */
+struct perfctrrec {
+    int fds[NUM_EVENTS];
+    int available;
+    int error;
+};
+
+/**
+ * Opens a counter for one event on the calling thread and any threads it
+ * creates later. The counter starts disabled and only counts user space.
+ *
+ * @param type the perf event type.
+ * @param config the perf event config.
+ *
+ * @return the file descriptor, or -1 if the event is not available.
+ */
+static int openEvent(unsigned int type, unsigned long long config){
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/**
+ * Reads a counter, scaling the count up if the kernel had to share the
+ * hardware counter with other events for part of the time.
+ *
+ * @param fd the counter's file descriptor.
+ *
+ * @return the estimated count.
+ */
+static double readEvent(int fd){
+    unsigned long long v[3];
+
+    if(read(fd, v, sizeof v) != sizeof v || v[2] == 0){
+        return 0.0;
+    }
+    return (double) v[0] * v[1] / v[2];
+}
+
+/**
+ * Opens a counter for each hardware event. Events that the kernel or
+ * processor does not support (or that the user is not allowed to count)
+ * are left out, so this never fails; if nothing could be opened the
+ * counters print a note saying so instead of numbers.
+ *
+ * @return result the new set of counters.
+ */
+perfctr perfctr_new(void){
+    perfctr result = emalloc(sizeof *result);
+    int i;
+
+    result->available = 0;
+    result->error = 0;
+    for(i = 0; i < NUM_EVENTS; i++){
+        result->fds[i] = openEvent(events[i].type, events[i].config);
+        if(result->fds[i] >= 0){
+            result->available++;
+        }else if(result->error == 0){
+            result->error = errno;
+        }
+    }
+    return result;
+}
+
+/**
+ * Starts (or resumes) counting. Counts keep adding up over every
+ * start/stop pair.
+ *
+ * @param p the counters.
+ */
+void perfctr_start(perfctr p){
+    int i;
+    for(i = 0; i < NUM_EVENTS; i++){
+        if(p->fds[i] >= 0){
+            ioctl(p->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+/**
+ * Stops counting.
+ *
+ * @param p the counters.
+ */
+void perfctr_stop(perfctr p){
+    int i;
+    for(i = 0; i < NUM_EVENTS; i++){
+        if(p->fds[i] >= 0){
+            ioctl(p->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+}
+
+/**
+ * Prints the total of each counter and the average per operation.
+ *
+ * @param p the counters.
+ * @param phase the name of the phase that was counted.
+ * @param ops the number of operations done in the phase.
+ * @param stream the stream to print to.
+ */
+void perfctr_print(perfctr p, char *phase, long ops, FILE *stream){
+    double count;
+    int i;
+
+    if(p->available == 0){
+        fprintf(stream, "%s counters: not available (%s)\n", phase,
+                strerror(p->error));
+        return;
+    }
+    fprintf(stream, "%s counters (%ld operations)\n", phase, ops);
+    for(i = 0; i < NUM_EVENTS; i++){
+        if(p->fds[i] < 0){
+            fprintf(stream, "  %-14s %16s\n", events[i].name, "n/a");
+            continue;
+        }
+        count = readEvent(p->fds[i]);
+        fprintf(stream, "  %-14s %16.0f %12.2f/op\n", events[i].name, count,
+                ops > 0 ? count / ops : 0.0);
+    }
+}
+
+/**
+ * Closes every counter and frees the counters.
+ *
+ * @param p the counters to be freed.
+ */
+void perfctr_free(perfctr p){
+    int i;
+    for(i = 0; i < NUM_EVENTS; i++){
+        if(p->fds[i] >= 0){
+            close(p->fds[i]);
+        }
+    }
+    free(p);
+}
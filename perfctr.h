@@ -0,0 +1,14 @@
+#ifndef PERFCTR_H_
+#define PERFCTR_H_
+
+#include <stdio.h>
+
+typedef struct perfctrrec *perfctr;
+
+extern perfctr perfctr_new(void);
+extern void perfctr_start(perfctr p);
+extern void perfctr_stop(perfctr p);
+extern void perfctr_print(perfctr p, char *phase, long ops, FILE *stream);
+extern void perfctr_free(perfctr p);
+
+#endif
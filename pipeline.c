@@ -0,0 +1,196 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "htable.h"
+#include "mylib.h"
+#include "pipeline.h"
+
+#define RING_SLOTS 64
+#define BATCH_BYTES 16384
+#define MAX_WORD 256
+#define CACHE_LINE 64
+
+/**
+ * A batch of tokens. The words are stored one after another, each with
+ * its terminating '\0'. The last batch the reader produces has last set.
+ */
+struct batch {
+    int count;
+    int last;
+    char words[BATCH_BYTES];
+};
+
+/**
+ * A single-producer/single-consumer ring of batches. The reader only
+ * writes head and the lookup thread only writes tail, and each is kept
+ * on its own cache line so the two threads do not share a line that
+ * either of them writes.
+ */
+struct ring {
+    _Atomic unsigned long head;
+    char pad1[CACHE_LINE - sizeof(unsigned long)];
+    _Atomic unsigned long tail;
+    char pad2[CACHE_LINE - sizeof(unsigned long)];
+    struct batch *slots;
+    FILE *stream;
+    double readBusy;
+    double readWait;
+};
+
+/**
+ * The reader stage. Tokens are read from the stream with getword and
+ * written straight into the next free slot of the ring, which is then
+ * published by advancing head.
+ *
+ * @param arg the ring.
+ *
+ * @return NULL.
+ */
+static void *readerStage(void *arg){
+    struct ring *r = arg;
+    unsigned long head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    struct batch *b;
+    double start;
+    int used, len;
+    int done = 0;
+
+    while(!done){
+        start = now();
+        while(head - atomic_load_explicit(&r->tail, memory_order_acquire)
+              == RING_SLOTS){
+            sched_yield();
+        }
+        r->readWait += now() - start;
+
+        start = now();
+        b = &r->slots[head % RING_SLOTS];
+        b->count = 0;
+        used = 0;
+        while(used <= BATCH_BYTES - MAX_WORD){
+            len = getword(b->words + used, MAX_WORD, r->stream);
+            if(len == EOF){
+                done = 1;
+                break;
+            }
+            used += len + 1;
+            b->count++;
+        }
+        b->last = done;
+        r->readBusy += now() - start;
+        atomic_store_explicit(&r->head, ++head, memory_order_release);
+    }
+    return NULL;
+}
+
+/**
+ * Checks every word in a stream against the hash table on the calling
+ * thread alone, for when the reader thread cannot be started. All of the
+ * time is counted as lookup time.
+ *
+ * @param h the hash table.
+ * @param stream the stream to read words from.
+ * @param f the function called, in order, with each unknown word.
+ * @param arg passed to f unchanged.
+ * @param times the time spent is stored here.
+ *
+ * @return the number of unknown words.
+ */
+static int serialCheck(htable h, FILE *stream, void f(char *word, void *arg),
+                       void *arg, pipeline_times *times){
+    char word[MAX_WORD];
+    int unknown = 0;
+
+    while(getword(word, sizeof word, stream) != EOF){
+        times->words++;
+        if(!htable_search(h, word)){
+            f(word, arg);
+            unknown++;
+        }
+    }
+    return unknown;
+}
+
+/**
+ * Checks every word in a stream against the hash table, reading and
+ * tokenizing on one thread while the calling thread does the lookups.
+ * The two stages are connected by a lock-free ring of token batches so
+ * that reading the file overlaps with searching the table. If the reader
+ * thread cannot be started the words are checked on the calling thread
+ * instead.
+ *
+ * @param h the hash table.
+ * @param stream the stream to read words from.
+ * @param f the function called, in order, with each unknown word.
+ * @param arg passed to f unchanged.
+ * @param times the time spent by each stage is stored here.
+ *
+ * @return the number of unknown words.
+ */
+int pipeline_check(htable h, FILE *stream, void f(char *word, void *arg),
+                   void *arg, pipeline_times *times){
+    struct ring r;
+    pthread_t reader;
+    unsigned long tail = 0;
+    struct batch *b;
+    double start, begin;
+    char *word;
+    int unknown = 0;
+    int last = 0;
+    int i;
+
+    atomic_init(&r.head, 0);
+    atomic_init(&r.tail, 0);
+    r.slots = emalloc(RING_SLOTS * sizeof r.slots[0]);
+    r.stream = stream;
+    r.readBusy = 0.0;
+    r.readWait = 0.0;
+    times->lookup_busy = 0.0;
+    times->lookup_wait = 0.0;
+    times->batches = 0;
+    times->words = 0;
+
+    begin = now();
+    if(pthread_create(&reader, NULL, readerStage, &r) != 0){
+        fprintf(stderr, "Can't start the reader thread, so the document is "
+                "checked on one thread.\n");
+        unknown = serialCheck(h, stream, f, arg, times);
+        times->lookup_busy = times->total = now() - begin;
+        times->read_busy = 0.0;
+        times->read_wait = 0.0;
+        free(r.slots);
+        return unknown;
+    }
+    while(!last){
+        start = now();
+        while(atomic_load_explicit(&r.head, memory_order_acquire) == tail){
+            sched_yield();
+        }
+        times->lookup_wait += now() - start;
+
+        start = now();
+        b = &r.slots[tail % RING_SLOTS];
+        word = b->words;
+        for(i = 0; i < b->count; i++){
+            if(!htable_search(h, word)){
+                f(word, arg);
+                unknown++;
+            }
+            word += strlen(word) + 1;
+        }
+        last = b->last;
+        times->lookup_busy += now() - start;
+        times->batches++;
+        times->words += b->count;
+        atomic_store_explicit(&r.tail, ++tail, memory_order_release);
+    }
+    pthread_join(reader, NULL);
+    times->total = now() - begin;
+    times->read_busy = r.readBusy;
+    times->read_wait = r.readWait;
+
+    free(r.slots);
+    return unknown;
+}
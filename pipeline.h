@@ -0,0 +1,26 @@
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <stdio.h>
+#include "htable.h"
+
+/**
+ * Wall clock time spent by each stage of the pipeline. Busy time is
+ * spent doing work, wait time is spent blocked on the other stage, so
+ * the stage with the most wait time is not the bottleneck.
+ */
+typedef struct pipeline_times_s {
+    double read_busy;
+    double read_wait;
+    double lookup_busy;
+    double lookup_wait;
+    double total;
+    int batches;
+    long words;
+} pipeline_times;
+
+extern int pipeline_check(htable h, FILE *stream,
+                          void f(char *word, void *arg), void *arg,
+                          pipeline_times *times);
+
+#endif
@@ -0,0 +1,525 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "htable_gen.h"
+#include "mylib.h"
+#include "sdindex.h"
+
+#define SD_INITIAL_SLOTS 1024
+#define SD_MAX_WORD 256
+#define SD_CHUNK_SIZE 16384
+
+/**
+ * The ids of the dictionary words that produce a deletion key. The first
+ * id is kept in the table itself, since most keys come from one word.
+ * Any more are in a circular list in the postings array, and last is the
+ * index of the newest of them (0 if there are none), whose next is the
+ * oldest.
+ */
+struct sdvalue {
+    int32_t first;
+    uint32_t last;
+};
+
+/**
+ * One more id for a deletion key, and the index of the next one.
+ */
+struct sdposting {
+    int32_t id;
+    uint32_t next;
+};
+
+/**
+ * A chunk of the word arena. The words are stored one after another,
+ * straight after the chunk header.
+ */
+struct sdchunk {
+    struct sdchunk *next;
+    size_t size;
+    size_t used;
+};
+
+/* Deletion keys are stored as their hash, with 0 marking an empty slot. */
+#define SD_KEY_EQ(a, b) ((a) == (b))
+
+/**
+ * Spreads the bits of a key's hash, since the table keeps only the low
+ * bits.
+ *
+ * @param key the hash of a deletion key.
+ *
+ * @return the mixed hash.
+ */
+static inline unsigned int sdMix(uint32_t key){
+    key ^= key >> 16;
+    key *= 0x45d9f3bu;
+    key ^= key >> 16;
+    return key;
+}
+
+HTABLE_GENERATE(sdtable, uint32_t, struct sdvalue, sdMix, SD_KEY_EQ, 0,
+                HTABLE_PROBE_LINEAR)
+
+/**
+ * sdindex struct, contains variables for:
+ * The maximum edit distance the index was built for, the table mapping
+ * the hash of each deletion key to the ids of the words that produce it
+ * (with the extra ids in the postings array), the dictionary words
+ * themselves (indexed by id, with the strings in an arena), a stamp
+ * array used to skip candidates already checked during a lookup, and a
+ * running total of the bytes allocated by the index.
+ *
+ * The deletion keys themselves are not stored. Two keys with the same
+ * hash share their ids, which is harmless since every candidate is
+ * checked with sdDistance anyway.
+ */
+struct sdindexrec {
+    int maxDistance;
+    struct sdtable table;
+    struct sdposting *postings;
+    uint32_t numPostings;
+    uint32_t capPostings;
+    struct sdchunk *chunks;
+    char **words;
+    int numWords;
+    int capWords;
+    int *seen;
+    int seenSize;
+    int stamp;
+    size_t memory;
+};
+
+/**
+ * Holds the closest words found so far while a suggestion lookup is
+ * running.
+ */
+struct sdresult {
+    char *word;
+    int best;
+    int count;
+    char **suggestions;
+    int maxSuggestions;
+};
+
+/**
+ * This static method hashes a deletion key with word_hash, moving a hash
+ * of 0 to 1 since 0 marks an empty slot.
+ *
+ * @param word the deletion key.
+ *
+ * @return the hash.
+ */
+static uint32_t sdHash(char *word){
+    unsigned int result = word_hash(word);
+    return result != 0 ? result : 1;
+}
+
+/**
+ * Allocates memory for the index and adds it to the memory total.
+ *
+ * @param idx the index the memory belongs to.
+ * @param s the amount of memory in bytes needed.
+ *
+ * @return a pointer to a chunk of memory.
+ */
+static void *sdAlloc(sdindex idx, size_t s){
+    idx->memory += s;
+    return emalloc(s);
+}
+
+/**
+ * Doubles the capacity of the table and moves every key into its new
+ * slot.
+ *
+ * @param idx the index to grow.
+ */
+static void sdGrow(sdindex idx){
+    struct sdtable old = idx->table;
+    int i;
+
+    sdtable_init(&idx->table, old.capacity * 2);
+    for(i = 0; i < old.capacity; i++){
+        if(old.keys[i] != 0){
+            *sdtable_put(&idx->table, old.keys[i]) = old.vals[i];
+        }
+    }
+    sdtable_destroy(&old);
+    /* the new arrays are twice the size of the old ones */
+    idx->memory += old.capacity * (sizeof old.keys[0] + sizeof old.vals[0]);
+}
+
+/**
+ * Copies a word into the word arena, starting a new chunk when the
+ * current one is full.
+ *
+ * @param idx the index that owns the arena.
+ * @param word the word to copy.
+ * @param len the length of the word.
+ *
+ * @return the copy of the word.
+ */
+static char *sdCopy(sdindex idx, char *word, int len){
+    struct sdchunk *c = idx->chunks;
+    char *result;
+
+    if(c == NULL || c->used + len + 1 > c->size){
+        c = sdAlloc(idx, SD_CHUNK_SIZE);
+        c->next = idx->chunks;
+        c->size = SD_CHUNK_SIZE;
+        c->used = sizeof *c;
+        idx->chunks = c;
+    }
+    result = (char *) c + c->used;
+    memcpy(result, word, len + 1);
+    c->used += len + 1;
+    return result;
+}
+
+/**
+ * Records that the word with the given id produces a deletion key,
+ * creating the entry for the key if needed.
+ *
+ * @param idx the index to add to.
+ * @param key the deletion key.
+ * @param id the id of the dictionary word.
+ */
+static void sdAddKey(sdindex idx, char *key, int id){
+    struct sdvalue *v;
+    struct sdposting *p;
+    int numKeys = idx->table.num_keys;
+
+    if(4 * (numKeys + 1) > 3 * idx->table.capacity){
+        sdGrow(idx);
+    }
+    v = sdtable_put(&idx->table, sdHash(key));
+    if(idx->table.num_keys > numKeys){
+        v->first = id;
+        v->last = 0;
+        return;
+    }
+    /* the same word can reach a key along more than one path */
+    if((v->last == 0 ? v->first : idx->postings[v->last].id) == id){
+        return;
+    }
+    if(idx->numPostings == idx->capPostings){
+        uint32_t newCap = idx->capPostings * 2;
+        idx->postings = erealloc(idx->postings,
+                                 newCap * sizeof idx->postings[0]);
+        idx->memory += (newCap - idx->capPostings) * sizeof idx->postings[0];
+        idx->capPostings = newCap;
+    }
+    p = &idx->postings[idx->numPostings];
+    p->id = id;
+    if(v->last == 0){
+        p->next = idx->numPostings;
+    }else{
+        p->next = idx->postings[v->last].next;
+        idx->postings[v->last].next = idx->numPostings;
+    }
+    v->last = idx->numPostings++;
+}
+
+/**
+ * Adds every string made by deleting one character from s to the index,
+ * then recurses until max_distance characters have been deleted.
+ *
+ * @param idx the index to add to.
+ * @param s the string to delete characters from.
+ * @param len the length of s.
+ * @param depth the number of characters already deleted.
+ * @param id the id of the dictionary word s came from.
+ */
+static void sdAddDeletes(sdindex idx, char *s, int len, int depth, int id){
+    char buf[SD_MAX_WORD];
+    int i;
+
+    for(i = 0; i < len; i++){
+        if(i > 0 && s[i] == s[i - 1]){
+            continue;
+        }
+        memcpy(buf, s, i);
+        memcpy(buf + i, s + i + 1, len - i);
+        sdAddKey(idx, buf, id);
+        if(depth + 1 < idx->maxDistance){
+            sdAddDeletes(idx, buf, len - 1, depth + 1, id);
+        }
+    }
+}
+
+/**
+ * Calculates the Levenshtein distance between two words, giving up once
+ * it is certain to be larger than limit.
+ *
+ * @param a the first word.
+ * @param b the second word.
+ * @param limit the largest distance of interest.
+ *
+ * @return the distance, or limit + 1 if it is larger than limit.
+ */
+static int sdDistance(char *a, char *b, int limit){
+    int row[2][SD_MAX_WORD + 1];
+    int la = strlen(a);
+    int lb = strlen(b);
+    int i, j, cur = 0;
+
+    if(la - lb > limit || lb - la > limit){
+        return limit + 1;
+    }
+    for(j = 0; j <= lb; j++){
+        row[0][j] = j;
+    }
+    for(i = 1; i <= la; i++){
+        int rowMin;
+        cur = i & 1;
+        row[cur][0] = i;
+        rowMin = i;
+        for(j = 1; j <= lb; j++){
+            int best = row[!cur][j - 1] + (a[i - 1] != b[j - 1]);
+            if(row[!cur][j] + 1 < best){
+                best = row[!cur][j] + 1;
+            }
+            if(row[cur][j - 1] + 1 < best){
+                best = row[cur][j - 1] + 1;
+            }
+            row[cur][j] = best;
+            if(best < rowMin){
+                rowMin = best;
+            }
+        }
+        if(rowMin > limit){
+            return limit + 1;
+        }
+    }
+    return row[cur][lb];
+}
+
+/**
+ * Checks one dictionary word that shares a deletion key with the
+ * misspelled word, keeping it if it is at the smallest edit distance
+ * found so far. Words already checked in this lookup are skipped.
+ *
+ * @param idx the index to search.
+ * @param id the id of the dictionary word.
+ * @param r the result of the lookup so far.
+ */
+static void sdCheckWord(sdindex idx, int id, struct sdresult *r){
+    int d;
+
+    if(idx->seen[id] == idx->stamp){
+        return;
+    }
+    idx->seen[id] = idx->stamp;
+    d = sdDistance(r->word, idx->words[id], idx->maxDistance);
+    if(d > idx->maxDistance || d > r->best){
+        return;
+    }
+    if(d < r->best){
+        r->best = d;
+        r->count = 0;
+    }
+    if(r->count < r->maxSuggestions){
+        r->suggestions[r->count++] = idx->words[id];
+    }
+}
+
+/**
+ * Checks every dictionary word that shares a deletion key with the
+ * misspelled word, in the order they were added.
+ *
+ * @param idx the index to search.
+ * @param key the deletion key to look up.
+ * @param r the result of the lookup so far.
+ */
+static void sdCheckKey(sdindex idx, char *key, struct sdresult *r){
+    struct sdvalue *v = sdtable_get(&idx->table, sdHash(key));
+    uint32_t p;
+
+    if(v == NULL){
+        return;
+    }
+    sdCheckWord(idx, v->first, r);
+    if(v->last == 0){
+        return;
+    }
+    p = v->last;
+    do{
+        p = idx->postings[p].next;
+        sdCheckWord(idx, idx->postings[p].id, r);
+    }while(p != v->last);
+}
+
+/**
+ * Looks up every string made by deleting up to max_distance characters
+ * from s.
+ *
+ * @param idx the index to search.
+ * @param s the string to delete characters from.
+ * @param len the length of s.
+ * @param depth the number of characters already deleted.
+ * @param r the result of the lookup so far.
+ */
+static void sdCheckDeletes(sdindex idx, char *s, int len, int depth,
+                           struct sdresult *r){
+    char buf[SD_MAX_WORD];
+    int i;
+
+    for(i = 0; i < len; i++){
+        if(i > 0 && s[i] == s[i - 1]){
+            continue;
+        }
+        memcpy(buf, s, i);
+        memcpy(buf + i, s + i + 1, len - i);
+        sdCheckKey(idx, buf, r);
+        if(depth + 1 < idx->maxDistance){
+            sdCheckDeletes(idx, buf, len - 1, depth + 1, r);
+        }
+    }
+}
+
+/**
+ * This method creates and returns a new, empty deletion index.
+ *
+ * @param max_distance the largest edit distance suggestions can have.
+ *
+ * @return result the index that has been created.
+ */
+sdindex sdindex_new(int max_distance){
+    sdindex result = emalloc(sizeof *result);
+    result->memory = sizeof *result;
+    result->maxDistance = max_distance;
+    sdtable_init(&result->table, SD_INITIAL_SLOTS);
+    result->memory += SD_INITIAL_SLOTS
+        * (sizeof result->table.keys[0] + sizeof result->table.vals[0]);
+    /* postings[0] is never used, so that a last of 0 means no list */
+    result->capPostings = SD_INITIAL_SLOTS;
+    result->numPostings = 1;
+    result->postings = sdAlloc(result, result->capPostings
+                               * sizeof result->postings[0]);
+    result->chunks = NULL;
+    result->words = NULL;
+    result->numWords = 0;
+    result->capWords = 0;
+    result->seen = NULL;
+    result->seenSize = 0;
+    result->stamp = 0;
+    return result;
+}
+
+/**
+ * Adds a dictionary word and all of its deletions to the index. Words
+ * that are already in the index are ignored.
+ *
+ * @param idx the index to add to.
+ * @param word the dictionary word.
+ */
+void sdindex_add(sdindex idx, char *word){
+    struct sdvalue *v = sdtable_get(&idx->table, sdHash(word));
+    int len = strlen(word);
+    uint32_t p;
+    int id;
+
+    if(len >= SD_MAX_WORD){
+        return;
+    }
+    if(v != NULL){
+        /* a word already added is among the ids for its own key */
+        if(strcmp(idx->words[v->first], word) == 0){
+            return;
+        }
+        p = v->last;
+        while(p != 0){
+            p = idx->postings[p].next;
+            if(strcmp(idx->words[idx->postings[p].id], word) == 0){
+                return;
+            }
+            if(p == v->last){
+                break;
+            }
+        }
+    }
+    if(idx->numWords == idx->capWords){
+        int newCap = idx->capWords == 0 ? 64 : idx->capWords * 2;
+        idx->words = erealloc(idx->words, newCap * sizeof idx->words[0]);
+        idx->memory += (newCap - idx->capWords) * sizeof idx->words[0];
+        idx->capWords = newCap;
+    }
+    id = idx->numWords++;
+    idx->words[id] = sdCopy(idx, word, len);
+
+    sdAddKey(idx, word, id);
+    sdAddDeletes(idx, word, len, 0, id);
+}
+
+/**
+ * Finds the dictionary words closest to a word that is not in the
+ * dictionary. Only words within the index's maximum edit distance are
+ * considered, and only those at the smallest distance found are returned.
+ *
+ * @param idx the index to search.
+ * @param word the misspelled word.
+ * @param suggestions an array that the suggested words are stored in.
+ * @param max_suggestions the size of the suggestions array.
+ *
+ * @return the number of suggestions stored.
+ */
+int sdindex_suggest(sdindex idx, char *word, char **suggestions,
+                    int max_suggestions){
+    struct sdresult r;
+    int len = strlen(word);
+
+    if(len >= SD_MAX_WORD){
+        return 0;
+    }
+    if(idx->seenSize < idx->numWords){
+        int i;
+        idx->seen = erealloc(idx->seen, idx->numWords * sizeof idx->seen[0]);
+        idx->memory += (idx->numWords - idx->seenSize) * sizeof idx->seen[0];
+        for(i = idx->seenSize; i < idx->numWords; i++){
+            idx->seen[i] = 0;
+        }
+        idx->seenSize = idx->numWords;
+    }
+    idx->stamp++;
+
+    r.word = word;
+    r.best = idx->maxDistance + 1;
+    r.count = 0;
+    r.suggestions = suggestions;
+    r.maxSuggestions = max_suggestions;
+
+    sdCheckKey(idx, word, &r);
+    sdCheckDeletes(idx, word, len, 0, &r);
+    return r.count;
+}
+
+/**
+ * Returns the number of bytes allocated by the index.
+ *
+ * @param idx the index.
+ *
+ * @return the memory used in bytes.
+ */
+size_t sdindex_memory(sdindex idx){
+    return idx->memory;
+}
+
+/**
+ * This method frees the table, the postings, the word arena and finally
+ * the index itself.
+ *
+ * @param idx the index to be freed.
+ */
+void sdindex_free(sdindex idx){
+    struct sdchunk *c, *next;
+
+    for(c = idx->chunks; c != NULL; c = next){
+        next = c->next;
+        free(c);
+    }
+    sdtable_destroy(&idx->table);
+    free(idx->postings);
+    free(idx->words);
+    free(idx->seen);
+    free(idx);
+}
@@ -0,0 +1,15 @@
+#ifndef SDINDEX_H_
+#define SDINDEX_H_
+
+#include <stddef.h>
+
+typedef struct sdindexrec *sdindex;
+
+extern sdindex sdindex_new(int max_distance);
+extern void sdindex_add(sdindex idx, char *word);
+extern int sdindex_suggest(sdindex idx, char *word, char **suggestions,
+                           int max_suggestions);
+extern size_t sdindex_memory(sdindex idx);
+extern void sdindex_free(sdindex idx);
+
+#endif
@@ -0,0 +1,349 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "htable.h"
+#include "mylib.h"
+#include "server.h"
+
+#define READ_CHUNK 4096
+#define MAX_REQUEST (1 << 20)
+
+/**
+ * The state kept for each client connection: the socket, any part of a
+ * request line that has been read but not yet answered, any part of the
+ * responses that the socket has not yet taken, and whether the client
+ * has finished sending.
+ */
+struct connection {
+    int fd;
+    char *in;
+    size_t inLen;
+    size_t inCap;
+    char *out;
+    size_t outPos;
+    size_t outLen;
+    size_t outCap;
+    int eof;
+};
+
+/**
+ * The state shared by every worker thread. The hash table is only ever
+ * searched once the server is running, so the workers share it without
+ * any locking.
+ */
+struct server {
+    htable h;
+    int epfd;
+    int listenfd;
+};
+
+/* Set by the signal handler to ask the workers to finish. */
+static volatile sig_atomic_t stopping = 0;
+
+/**
+ * Signal handler for SIGINT and SIGTERM.
+ *
+ * @param sig the signal number (unused).
+ */
+static void serverStop(int sig){
+    (void) sig;
+    stopping = 1;
+}
+
+/**
+ * Re-arms a one-shot epoll registration so that the next event on the
+ * file descriptor is delivered to exactly one worker.
+ *
+ * @param s the server.
+ * @param fd the file descriptor.
+ * @param ptr the data returned with the event.
+ * @param events EPOLLIN to wait for requests, or EPOLLOUT to wait for
+ *               room to send responses.
+ */
+static void serverRearm(struct server *s, int fd, void *ptr, int events){
+    struct epoll_event ev;
+    ev.events = events | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.ptr = ptr;
+    epoll_ctl(s->epfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+/**
+ * Writes as much of a connection's pending responses as the socket will
+ * take without blocking.
+ *
+ * @param c the connection.
+ *
+ * @return 0 on success (even if some output is still pending), -1 if the
+ * connection failed.
+ */
+static int flushOutput(struct connection *c){
+    ssize_t n;
+
+    while(c->outPos < c->outLen){
+        n = write(c->fd, c->out + c->outPos, c->outLen - c->outPos);
+        if(n > 0){
+            c->outPos += n;
+        }else if(n < 0 && errno == EINTR){
+            continue;
+        }else if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            return 0;
+        }else{
+            return -1;
+        }
+    }
+    c->outPos = 0;
+    c->outLen = 0;
+    return 0;
+}
+
+/**
+ * Makes sure a connection's response buffer has room for more bytes.
+ *
+ * @param c the connection.
+ * @param need the number of bytes needed.
+ */
+static void reserveOutput(struct connection *c, size_t need){
+    if(c->outCap - c->outLen < need){
+        c->outCap = c->outCap * 2 + need + READ_CHUNK;
+        c->out = erealloc(c->out, c->outCap);
+    }
+}
+
+/**
+ * Answers one request line. The line is split into words the same way
+ * getword splits a document (see sgetword), each word is searched for
+ * in the hash table, and its frequency (0 if unknown) is appended to the
+ * connection's responses, so the response has one number per word.
+ *
+ * @param h the hash table.
+ * @param c the connection.
+ * @param line the request line, without its newline.
+ */
+static void answerLine(htable h, struct connection *c, char *line){
+    char word[256];
+    int first = 1;
+
+    while(sgetword(word, sizeof word, &line) != EOF){
+        reserveOutput(c, 16);
+        c->outLen += sprintf(c->out + c->outLen, first ? "%d" : " %d",
+                             htable_search(h, word));
+        first = 0;
+    }
+    reserveOutput(c, 1);
+    c->out[c->outLen++] = '\n';
+}
+
+/**
+ * Closes a client connection and frees its state.
+ *
+ * @param c the connection.
+ */
+static void closeConnection(struct connection *c){
+    close(c->fd);
+    free(c->in);
+    free(c->out);
+    free(c);
+}
+
+/**
+ * Handles a ready connection. Responses the socket could not take last
+ * time are sent first, and nothing more is read until they have all
+ * gone, so a client that does not read its responses only holds up its
+ * own connection. Otherwise up to MAX_REQUEST bytes are read and every
+ * complete request line is answered. Because the connection is
+ * registered with EPOLLONESHOT, only one worker handles it at a time and
+ * responses keep the order of the requests.
+ *
+ * @param s the server.
+ * @param c the connection.
+ */
+static void serveConnection(struct server *s, struct connection *c){
+    char *start, *nl;
+    ssize_t n;
+
+    if(flushOutput(c) != 0){
+        closeConnection(c);
+        return;
+    }
+    while(c->outLen == 0 && !c->eof && c->inLen <= MAX_REQUEST){
+        if(c->inCap - c->inLen < READ_CHUNK){
+            c->inCap = c->inCap * 2 + READ_CHUNK;
+            c->in = erealloc(c->in, c->inCap);
+        }
+        n = read(c->fd, c->in + c->inLen, c->inCap - c->inLen);
+        if(n > 0){
+            c->inLen += n;
+        }else if(n < 0 && errno == EINTR){
+            continue;
+        }else if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            break;
+        }else{
+            c->eof = 1;
+        }
+    }
+
+    start = c->in;
+    while((nl = memchr(start, '\n', c->in + c->inLen - start)) != NULL){
+        *nl = '\0';
+        answerLine(s->h, c, start);
+        start = nl + 1;
+    }
+    c->inLen -= start - c->in;
+    memmove(c->in, start, c->inLen);
+
+    /* a line longer than MAX_REQUEST is never answered */
+    if(flushOutput(c) != 0 || c->inLen > MAX_REQUEST){
+        closeConnection(c);
+    }else if(c->outLen > 0){
+        serverRearm(s, c->fd, c, EPOLLOUT);
+    }else if(c->eof){
+        closeConnection(c);
+    }else{
+        serverRearm(s, c->fd, c, EPOLLIN);
+    }
+}
+
+/**
+ * Accepts every pending connection on the listening socket and adds it
+ * to the epoll set.
+ *
+ * @param s the server.
+ */
+static void acceptConnections(struct server *s){
+    struct epoll_event ev;
+    struct connection *c;
+    int fd;
+
+    while((fd = accept4(s->listenfd, NULL, NULL, SOCK_NONBLOCK)) >= 0){
+        c = emalloc(sizeof *c);
+        c->fd = fd;
+        c->in = NULL;
+        c->inLen = 0;
+        c->inCap = 0;
+        c->out = NULL;
+        c->outPos = 0;
+        c->outLen = 0;
+        c->outCap = 0;
+        c->eof = 0;
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+        ev.data.ptr = c;
+        if(epoll_ctl(s->epfd, EPOLL_CTL_ADD, fd, &ev) != 0){
+            closeConnection(c);
+        }
+    }
+    serverRearm(s, s->listenfd, NULL, EPOLLIN);
+}
+
+/**
+ * The body of each worker thread. Every worker waits on the shared epoll
+ * set and handles one ready connection (or the listening socket) at a
+ * time until the server is asked to stop.
+ *
+ * @param arg the server.
+ *
+ * @return NULL.
+ */
+static void *serverWorker(void *arg){
+    struct server *s = arg;
+    struct epoll_event ev;
+    int n;
+
+    while(!stopping){
+        n = epoll_wait(s->epfd, &ev, 1, 200);
+        if(n <= 0){
+            continue;
+        }
+        if(ev.data.ptr == NULL){
+            acceptConnections(s);
+        }else{
+            serveConnection(s, ev.data.ptr);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Serves word check requests for a filled hash table over a Unix domain
+ * socket until SIGINT or SIGTERM is received.
+ *
+ * A client sends lines of words and receives one line back for each,
+ * holding the frequency of every word in the same order (0 for words
+ * that are not in the table). Words are split and normalised the same
+ * way as in a document checked with -c: runs of letters and digits,
+ * folded to lower case, with apostrophes dropped, so "Hello," is looked
+ * up as "hello" and "don't" as "dont". Lines longer than 1MB close the
+ * connection.
+ *
+ * @param h the hash table, which must not be changed while serving.
+ * @param socket_path the path to create the socket at.
+ * @param num_workers the number of worker threads.
+ *
+ * @return 0 when the server stops cleanly, -1 if it could not start.
+ */
+int server_run(htable h, char *socket_path, int num_workers){
+    struct server s;
+    struct sockaddr_un addr;
+    struct epoll_event ev;
+    struct sigaction sa;
+    pthread_t *workers;
+    int i;
+
+    if(strlen(socket_path) >= sizeof addr.sun_path){
+        fprintf(stderr, "Socket path '%s' is too long.\n", socket_path);
+        return -1;
+    }
+    s.h = h;
+    s.listenfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if(s.listenfd < 0){
+        perror("socket");
+        return -1;
+    }
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    unlink(socket_path);
+    if(bind(s.listenfd, (struct sockaddr *) &addr, sizeof addr) != 0 ||
+       listen(s.listenfd, SOMAXCONN) != 0){
+        perror(socket_path);
+        close(s.listenfd);
+        return -1;
+    }
+
+    s.epfd = epoll_create1(0);
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.ptr = NULL;
+    epoll_ctl(s.epfd, EPOLL_CTL_ADD, s.listenfd, &ev);
+
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = serverStop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    if(num_workers < 1){
+        num_workers = 1;
+    }
+    fprintf(stderr, "Listening on %s with %d workers\n", socket_path,
+            num_workers);
+    workers = emalloc(num_workers * sizeof workers[0]);
+    for(i = 0; i < num_workers; i++){
+        pthread_create(&workers[i], NULL, serverWorker, &s);
+    }
+    for(i = 0; i < num_workers; i++){
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+
+    close(s.epfd);
+    close(s.listenfd);
+    unlink(socket_path);
+    return 0;
+}
@@ -0,0 +1,11 @@
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include "htable.h"
+
+#define DEFAULT_SOCKET_PATH "/tmp/asgn.sock"
+#define DEFAULT_WORKERS 4
+
+extern int server_run(htable h, char *socket_path, int num_workers);
+
+#endif
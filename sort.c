@@ -0,0 +1,336 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mylib.h"
+#include "sort.h"
+
+#define RADIX 256
+#define INSERTION_CUTOFF 32
+#define PARALLEL_CUTOFF 16384
+#define MAX_THREADS 64
+
+/**
+ * The state shared by the threads of a parallel MSD sort. After the
+ * first pass the entries are grouped by their first character, and each
+ * thread takes the next unsorted group until none are left.
+ */
+struct alphaJob {
+    sort_entry *a;
+    sort_entry *tmp;
+    int offsets[RADIX + 1];
+    _Atomic int next;
+};
+
+/**
+ * The state shared by the threads of one pass of a parallel LSD sort.
+ * Each thread handles its own slice of src, with its own row of counts.
+ */
+struct freqJob {
+    sort_entry *src;
+    sort_entry *dst;
+    int n;
+    int threads;
+    int shift;
+    int (*counts)[RADIX];
+};
+
+/**
+ * The argument given to each thread of a parallel LSD pass.
+ */
+struct freqArg {
+    struct freqJob *job;
+    int id;
+};
+
+/**
+ * Sorts a small number of entries by the part of their words starting at
+ * depth.
+ *
+ * @param a the entries.
+ * @param n the number of entries.
+ * @param depth the number of leading characters the entries share.
+ */
+static void insertionSort(sort_entry *a, int n, int depth){
+    sort_entry t;
+    int i, j;
+
+    for(i = 1; i < n; i++){
+        t = a[i];
+        for(j = i; j > 0 && strcmp(a[j - 1].word + depth, t.word + depth) > 0;
+            j--){
+            a[j] = a[j - 1];
+        }
+        a[j] = t;
+    }
+}
+
+/**
+ * Distributes entries into groups by the character at depth, leaving the
+ * start of each group in offsets.
+ *
+ * @param a the entries, which are left grouped.
+ * @param tmp a buffer at least as big as a.
+ * @param n the number of entries.
+ * @param depth the character to group by.
+ * @param offsets the start of each group, with offsets[RADIX] == n.
+ */
+static void msdPass(sort_entry *a, sort_entry *tmp, int n, int depth,
+                    int *offsets){
+    int pos[RADIX];
+    int i, c;
+
+    memset(pos, 0, sizeof pos);
+    for(i = 0; i < n; i++){
+        pos[(unsigned char) a[i].word[depth]]++;
+    }
+    offsets[0] = 0;
+    for(c = 0; c < RADIX; c++){
+        offsets[c + 1] = offsets[c] + pos[c];
+        pos[c] = offsets[c];
+    }
+    for(i = 0; i < n; i++){
+        tmp[pos[(unsigned char) a[i].word[depth]]++] = a[i];
+    }
+    memcpy(a, tmp, n * sizeof a[0]);
+}
+
+/**
+ * Sorts entries by their words with a most significant digit first radix
+ * sort, starting at depth. Group 0 holds the words that end at depth, and
+ * is already in order.
+ *
+ * @param a the entries.
+ * @param tmp a buffer at least as big as a.
+ * @param n the number of entries.
+ * @param depth the number of leading characters the entries share.
+ */
+static void msdSort(sort_entry *a, sort_entry *tmp, int n, int depth){
+    int offsets[RADIX + 1];
+    int c;
+
+    if(n <= INSERTION_CUTOFF){
+        insertionSort(a, n, depth);
+        return;
+    }
+    msdPass(a, tmp, n, depth, offsets);
+    for(c = 1; c < RADIX; c++){
+        if(offsets[c + 1] - offsets[c] > 1){
+            msdSort(a + offsets[c], tmp + offsets[c],
+                    offsets[c + 1] - offsets[c], depth + 1);
+        }
+    }
+}
+
+/**
+ * The body of each thread of a parallel MSD sort.
+ *
+ * @param arg the shared job.
+ *
+ * @return NULL.
+ */
+static void *alphaWorker(void *arg){
+    struct alphaJob *job = arg;
+    int c, n;
+
+    while((c = atomic_fetch_add(&job->next, 1)) < RADIX){
+        n = job->offsets[c + 1] - job->offsets[c];
+        if(c > 0 && n > 1){
+            msdSort(job->a + job->offsets[c], job->tmp + job->offsets[c], n, 1);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Runs a function on several threads and waits for them all to finish.
+ * With one thread the function is simply called, and if a thread cannot
+ * be started its share is run on the calling thread instead, which every
+ * caller allows since no share waits for another.
+ *
+ * @param f the function.
+ * @param args the argument for each thread.
+ * @param size the size of each argument.
+ * @param threads the number of threads.
+ */
+static void runThreads(void *f(void *), void *args, size_t size,
+                       int threads){
+    pthread_t ids[MAX_THREADS];
+    int started[MAX_THREADS];
+    int i;
+
+    if(threads == 1){
+        f(args);
+        return;
+    }
+    for(i = 0; i < threads; i++){
+        started[i] = pthread_create(&ids[i], NULL, f,
+                                    (char *) args + i * size) == 0;
+        if(!started[i]){
+            f((char *) args + i * size);
+        }
+    }
+    for(i = 0; i < threads; i++){
+        if(started[i]){
+            pthread_join(ids[i], NULL);
+        }
+    }
+}
+
+/**
+ * Works out how many threads to use for n entries.
+ *
+ * @param n the number of entries.
+ * @param threads the number of threads asked for.
+ *
+ * @return the number of threads to use.
+ */
+static int threadCount(int n, int threads){
+    if(n < PARALLEL_CUTOFF || threads < 1){
+        return 1;
+    }
+    return threads > MAX_THREADS ? MAX_THREADS : threads;
+}
+
+/**
+ * This method sorts entries into alphabetical order of their words with
+ * an MSD radix sort. The first pass groups the entries by their first
+ * character, and the groups are then sorted in parallel.
+ *
+ * @param a the entries.
+ * @param n the number of entries.
+ * @param threads the number of threads to use.
+ */
+void sort_alpha(sort_entry *a, int n, int threads){
+    struct alphaJob job;
+
+    threads = threadCount(n, threads);
+    job.a = a;
+    job.tmp = emalloc((n > 0 ? n : 1) * sizeof a[0]);
+    if(n <= INSERTION_CUTOFF){
+        insertionSort(a, n, 0);
+    }else{
+        msdPass(a, job.tmp, n, 0, job.offsets);
+        atomic_init(&job.next, 0);
+        /* every thread shares the one job */
+        runThreads(alphaWorker, &job, 0, threads);
+    }
+    free(job.tmp);
+}
+
+/**
+ * Returns the LSD digit of an entry for the current pass. The digit is
+ * inverted so that higher frequencies sort first.
+ *
+ * @param e the entry.
+ * @param shift the position of the digit.
+ *
+ * @return the digit.
+ */
+static int freqDigit(sort_entry *e, int shift){
+    return RADIX - 1 - ((e->freq >> shift) & (RADIX - 1));
+}
+
+/**
+ * Counts the digits in one thread's slice for an LSD pass.
+ *
+ * @param arg the thread's argument.
+ *
+ * @return NULL.
+ */
+static void *freqCount(void *arg){
+    struct freqArg *fa = arg;
+    struct freqJob *job = fa->job;
+    int *counts = job->counts[fa->id];
+    int start = (long) job->n * fa->id / job->threads;
+    int end = (long) job->n * (fa->id + 1) / job->threads;
+    int i;
+
+    memset(counts, 0, RADIX * sizeof counts[0]);
+    for(i = start; i < end; i++){
+        counts[freqDigit(&job->src[i], job->shift)]++;
+    }
+    return NULL;
+}
+
+/**
+ * Moves one thread's slice to its place in the output of an LSD pass.
+ * Each thread's counts have been turned into the positions its entries
+ * go to.
+ *
+ * @param arg the thread's argument.
+ *
+ * @return NULL.
+ */
+static void *freqScatter(void *arg){
+    struct freqArg *fa = arg;
+    struct freqJob *job = fa->job;
+    int *pos = job->counts[fa->id];
+    int start = (long) job->n * fa->id / job->threads;
+    int end = (long) job->n * (fa->id + 1) / job->threads;
+    int i;
+
+    for(i = start; i < end; i++){
+        job->dst[pos[freqDigit(&job->src[i], job->shift)]++] = job->src[i];
+    }
+    return NULL;
+}
+
+/**
+ * This method sorts entries into decreasing order of frequency with an
+ * LSD radix sort, one byte of the frequency per pass. Each pass counts
+ * and moves the entries in parallel slices. The sort is stable, so
+ * entries sorted with sort_alpha first end up alphabetical within each
+ * frequency.
+ *
+ * @param a the entries.
+ * @param n the number of entries.
+ * @param threads the number of threads to use.
+ */
+void sort_freq(sort_entry *a, int n, int threads){
+    struct freqArg args[MAX_THREADS];
+    int counts[MAX_THREADS][RADIX];
+    struct freqJob job;
+    sort_entry *tmp;
+    unsigned int max = 0;
+    int i, d, t, pos;
+
+    threads = threadCount(n, threads);
+    for(i = 0; i < n; i++){
+        if(a[i].freq > max){
+            max = a[i].freq;
+        }
+    }
+    tmp = emalloc((n > 0 ? n : 1) * sizeof a[0]);
+    job.src = a;
+    job.dst = tmp;
+    job.n = n;
+    job.threads = threads;
+    job.counts = counts;
+    for(t = 0; t < threads; t++){
+        args[t].job = &job;
+        args[t].id = t;
+    }
+
+    /* the passes over bytes above the largest frequency would not move
+     * anything, so they are skipped */
+    for(job.shift = 0; job.shift < 32 && (job.shift == 0 || max >> job.shift);
+        job.shift += 8){
+        runThreads(freqCount, args, sizeof args[0], threads);
+        pos = 0;
+        for(d = 0; d < RADIX; d++){
+            for(t = 0; t < threads; t++){
+                int c = counts[t][d];
+                counts[t][d] = pos;
+                pos += c;
+            }
+        }
+        runThreads(freqScatter, args, sizeof args[0], threads);
+        job.dst = job.src;
+        job.src = job.src == a ? tmp : a;
+    }
+    if(job.src != a){
+        memcpy(a, job.src, n * sizeof a[0]);
+    }
+    free(tmp);
+}
@@ -0,0 +1,15 @@
+#ifndef SORT_H_
+#define SORT_H_
+
+/**
+ * A word from the hash table and its frequency.
+ */
+typedef struct sort_entry_s {
+    char *word;
+    unsigned int freq;
+} sort_entry;
+
+extern void sort_alpha(sort_entry *a, int n, int threads);
+extern void sort_freq(sort_entry *a, int n, int threads);
+
+#endif
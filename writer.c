@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mylib.h"
+#include "writer.h"
+
+/**
+ * writer struct, contains the stream being written to and a buffer of
+ * output that has not been written to it yet.
+ */
+struct writerrec {
+    FILE *stream;
+    char *buf;
+    size_t size;
+    size_t used;
+};
+
+/**
+ * This method creates a buffered writer. Output is collected in the
+ * writer's own buffer and handed to the stream in large blocks, which
+ * avoids the per-call cost of printf when writing many short lines.
+ *
+ * @param stream the stream to write to.
+ * @param size the size of the buffer in bytes.
+ *
+ * @return result the new writer.
+ */
+writer writer_new(FILE *stream, size_t size){
+    writer result = emalloc(sizeof *result);
+    result->stream = stream;
+    result->size = size < 64 ? 64 : size;
+    result->buf = emalloc(result->size);
+    result->used = 0;
+    return result;
+}
+
+/**
+ * Writes everything in the buffer to the stream.
+ *
+ * @param w the writer.
+ */
+void writer_flush(writer w){
+    if(w->used > 0){
+        fwrite(w->buf, 1, w->used, w->stream);
+        w->used = 0;
+    }
+}
+
+/**
+ * Writes a string.
+ *
+ * @param w the writer.
+ * @param s the string to write.
+ */
+void writer_puts(writer w, char *s){
+    size_t len = strlen(s);
+
+    if(w->used + len > w->size){
+        writer_flush(w);
+        if(len > w->size){
+            fwrite(s, 1, len, w->stream);
+            return;
+        }
+    }
+    memcpy(w->buf + w->used, s, len);
+    w->used += len;
+}
+
+/**
+ * Writes a single character.
+ *
+ * @param w the writer.
+ * @param c the character to write.
+ */
+void writer_putc(writer w, char c){
+    if(w->used == w->size){
+        writer_flush(w);
+    }
+    w->buf[w->used++] = c;
+}
+
+/**
+ * Writes an unsigned number in decimal, left justified and padded with
+ * spaces to at least width characters (like printf's "%-*u").
+ *
+ * @param w the writer.
+ * @param value the number to write.
+ * @param width the minimum number of characters to write.
+ */
+void writer_putu(writer w, unsigned int value, int width){
+    char digits[16];
+    int n = 0;
+    int i;
+
+    do{
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    }while(value > 0);
+    if(w->used + n + width > w->size){
+        writer_flush(w);
+    }
+    for(i = n - 1; i >= 0; i--){
+        w->buf[w->used++] = digits[i];
+    }
+    for(i = n; i < width; i++){
+        w->buf[w->used++] = ' ';
+    }
+}
+
+/**
+ * Flushes the writer and frees it. The stream is left open.
+ *
+ * @param w the writer to be freed.
+ */
+void writer_free(writer w){
+    writer_flush(w);
+    free(w->buf);
+    free(w);
+}
@@ -0,0 +1,15 @@
+#ifndef WRITER_H_
+#define WRITER_H_
+
+#include <stdio.h>
+
+typedef struct writerrec *writer;
+
+extern writer writer_new(FILE *stream, size_t size);
+extern void writer_puts(writer w, char *s);
+extern void writer_putc(writer w, char c);
+extern void writer_putu(writer w, unsigned int value, int width);
+extern void writer_flush(writer w);
+extern void writer_free(writer w);
+
+#endif